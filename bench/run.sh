@@ -0,0 +1,62 @@
+#!/bin/sh
+# Time sets of benchmark programs that compute the same thing in different
+# ways, checking that they agree. Pass names (e.g. `filter`) to run only some.
+# Each variant is run $RUNS times, and the best time is reported. Set $BSVM to
+# measure a different build.
+set -e
+
+HERE="$(realpath "$(dirname "$0")")"
+cd "$HERE"
+
+BSVM="${BSVM:-../bin/bsvm}"
+RUNS="${RUNS:-3}"
+BSASM=../scripts/bsasm.py
+LIB=../packages/stdlib/src
+
+if [ "$#" = 0 ]; then
+    benches="filter append"
+else
+    benches=$@
+fi
+
+# run a program, leaving its best wall-clock time in milliseconds in $elapsed and
+# its exit code in $ec
+timed() {
+    best=""
+    for _ in $(seq "$RUNS"); do
+        timedOnce "$1"
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+    done
+    elapsed=$best
+}
+timedOnce() {
+    start=$(date +%s%N)
+    set +e
+        $BSVM "$1"
+        ec=$?
+    set -e
+    end=$(date +%s%N)
+    elapsed=$(( (end - start) / 1000000 ))
+}
+
+success=0
+for bench in $benches; do
+    case "$bench" in
+        filter) variants="branchy predicated"; libs="" ;;
+        append) variants="bytewise bulk"; libs="isa ByteBuf" ;;
+        *) echo >&2 "unknown benchmark: $bench"; exit 1 ;;
+    esac
+    expect=""
+    for variant in $variants; do
+        "$BSASM" $(for lib in $libs; do echo "$LIB/$lib.bS"; done) "$bench-$variant.bS"
+        timed "./$bench-$variant.bsvm"
+        echo "$bench $variant: ${elapsed}ms (exit $ec)"
+        if [ -n "$expect" ] && [ "$ec" != "$expect" ]; then
+            echo >&2 "[FAIL] $bench-$variant disagrees ($ec, expecting $expect)"
+            success=$((success + 1))
+        fi
+        expect=$ec
+    done
+done
+
+exit "$success"
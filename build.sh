@@ -6,4 +6,22 @@ cd "$here"
 
 mkdir -p bin
 
-gcc -std=c11 -I src -Wall -Werror src/*.c -o bin/bsvm
+CFLAGS="-std=c11 -I src -O2 -Wall -Werror"
+
+# libbsvm is everything but the command-line front end; the shared library
+# exports only what bsvm.h marks BSVM_API
+rm -rf bin/obj
+mkdir -p bin/obj
+for src in src/*.c; do
+    case "$src" in
+        src/main.c|src/serve.c) continue ;;
+    esac
+    obj="bin/obj/$(basename "$src" .c).o"
+    gcc $CFLAGS -fPIC -fvisibility=hidden -c "$src" -o "$obj"
+done
+rm -f bin/libbsvm.a
+ar rcs bin/libbsvm.a bin/obj/*.o
+gcc -shared -pthread bin/obj/*.o -o bin/libbsvm.so
+
+gcc $CFLAGS src/main.c src/serve.c bin/libbsvm.a -pthread -o bin/bsvm
+gcc $CFLAGS src/bsvmc/*.c -o bin/bsvmc
@@ -13,9 +13,27 @@ SRC=.
 "$UNHEX" "$SRC/donothing.hex"
 "$UNHEX" "$SRC/exit84.hex"
 "$BSASM" "$SRC/exit84.bS"
+"$BSASM" "$SRC/bits.bS"
 "$BSASM" "$SRC/factorial.bS"
+"$BSASM" "$SRC/indirect.bS"
 "$BSASM" "$SRC/hello.bS"
+"$BSASM" "$SRC/leak.bS"
+"$BSASM" "$SRC/garbage.bS"
+"$BSASM" "$SRC/aio.bS"
+"$BSASM" "$SRC/snapshot.bS"
+"$BSASM" "$SRC/sized.bS"
+"$BSASM" "$SRC/simd.bS"
+"$BSASM" "$SRC/predicated.bS"
+"$BSASM" "$SRC/wide.bS"
+"$BSASM" "$SRC/numbers.bS"
+"$BSASM" "$SRC/sort.bS"
 "$BSASM" \
     "$LIB/isa.bS" \
     "$LIB/ByteBuf.bS" \
     "$SRC/sponge.bS"
+"$BSASM" \
+    "$LIB/isa.bS" \
+    "$LIB/Ring.bS" \
+    "$SRC/pipeline.bS"
+
+gcc -std=c11 -Wall -Werror -I ../src "$SRC/embed.c" ../bin/libbsvm.a -pthread -o embed
@@ -0,0 +1,74 @@
+// A host program embedding bsvm through libbsvm.
+// It greets several names with one reused machine, capturing the output in
+// memory, runs factorial a few instructions at a time, and then survives a
+// program with a bad opcode.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bsvm.h"
+
+
+typedef struct Capture Capture;
+struct Capture {
+  char buf[256];
+  size_t len;
+};
+
+static size_t capture(void* ctx, const char* buf, size_t len) {
+  Capture* self = ctx;
+  if (len > sizeof(self->buf) - self->len) { return 0; }
+  memcpy(self->buf + self->len, buf, len);
+  self->len += len;
+  return len;
+}
+
+static BsvmProgram* loadIntoMemory(const char* filename) {
+  FILE* fp = fopen(filename, "r");
+  if (fp == NULL) { return NULL; }
+  static char buf[4096];
+  size_t len = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  return bsvmLoadBuffer(buf, len);
+}
+
+int main(void) {
+  BsvmProgram* hello = loadIntoMemory("hello.bsvm");
+  BsvmProgram* factorial = bsvmLoadFile("factorial.bsvm");
+  BsvmMachine* machine = bsvmNewMachine();
+  if (hello == NULL || factorial == NULL || machine == NULL) {
+    fprintf(stderr, "[ERROR] setup failed\n");
+    return 1;
+  }
+
+  Capture out = { .len = 0 };
+  if (bsvmSetStream(machine, 1, &out, NULL, capture)) { return 1; }
+  char* names[] = { "Ann", "Bo", "Cy" };
+  for (size_t i = 0; i < 3; ++i) {
+    char* argv[] = { "hello.bsvm", names[i] };
+    out.len = 0;
+    if (bsvmStart(machine, hello, 2, argv)) { return 1; }
+    if (bsvmRun(machine, 0) != BSVM_EXITED) { return 1; }
+    printf("%d: %.*s", bsvmExitCode(machine), (int)out.len, out.buf);
+  }
+
+  char* argv[] = { "factorial.bsvm" };
+  if (bsvmStart(machine, factorial, 1, argv)) { return 1; }
+  int slices = 1;
+  while (bsvmRun(machine, 3) == BSVM_OUT_OF_FUEL) { ++slices; }
+  printf("factorial: %d (in %s slices)\n", bsvmExitCode(machine), slices > 1 ? "several" : "one");
+
+  // no registers, then an unassigned opcode: the machine halts with -1 instead
+  // of taking the host down
+  static const char bad[] = "BsvmExe1" "\0\0\0\5" "\0\0\0\0" "\0\0\0\0" "\x01";
+  BsvmProgram* broken = bsvmLoadBuffer(bad, sizeof(bad) - 1);
+  if (broken == NULL || bsvmStart(machine, broken, 1, argv)) { return 1; }
+  if (bsvmRun(machine, 0) != BSVM_EXITED) { return 1; }
+  printf("broken: %d\n", bsvmExitCode(machine));
+
+  bsvmFreeMachine(machine);
+  bsvmFreeProgram(broken);
+  bsvmFreeProgram(factorial);
+  bsvmFreeProgram(hello);
+  return 0;
+}
@@ -45,6 +45,76 @@ success=0
         success=$((success + 1))
     fi
 
+    echo >&2 "bits.bS"
+    set +e
+        $BSVM ./bits.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 42 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 42"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "sized.bS"
+    set +e
+        $BSVM ./sized.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 63 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 63"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "simd.bS"
+    set +e
+        $BSVM ./simd.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 34 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 34"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "predicated.bS"
+    set +e
+        $BSVM ./predicated.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 77 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 77"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "wide.bS"
+    set +e
+        $BSVM ./wide.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 99 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 99"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "numbers.bS"
+    set +e
+        $BSVM ./numbers.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 55 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 55"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "sort.bS"
+    set +e
+        $BSVM ./sort.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 66 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 66"
+        success=$((success + 1))
+    fi
+
     echo >&2 "factorial.bS"
     set +e
         $BSVM ./factorial.bsvm
@@ -55,6 +125,52 @@ success=0
         success=$((success + 1))
     fi
 
+    echo >&2 "factorial.bS --fuel 100"
+    set +e
+        $BSVM --fuel 100 ./factorial.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 120 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 120"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "factorial.bS --fuel 3"
+    set +e
+        $BSVM --fuel 3 ./factorial.bsvm 2>/dev/null
+        ec=$?
+    set -e
+    if [ "$ec" != 255 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 255"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "factorial.bS --trace"
+    trace="$(mktemp)"
+    set +e
+        $BSVM --trace "$trace" ./factorial.bsvm
+        ec=$?
+    set -e
+    ../scripts/decode-trace.py "$trace" > "$GOLDEN/factorial-trace.actual"
+    rm "$trace"
+    if [ "$ec" != 120 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 120"
+        success=$((success + 1))
+    elif ! diff "$GOLDEN/factorial-trace.expected" "$GOLDEN/factorial-trace.actual"; then
+        echo >&2 "[FAIL] actual output does not match expected"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "indirect.bS"
+    set +e
+        $BSVM ./indirect.bsvm
+        ec=$?
+    set -e
+    if [ "$ec" != 168 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 168"
+        success=$((success + 1))
+    fi
+
     echo >&2 "hello.bS"
     set +e
         $BSVM ./hello.bsvm > "$GOLDEN/hello.actual"
@@ -80,6 +196,23 @@ success=0
         success=$((success + 1))
     fi
 
+    echo >&2 "hello.bS Joy --perf-stats"
+    set +e
+        $BSVM --perf-stats ./hello.bsvm Joy > "$GOLDEN/hello-joy.actual" 2> "$GOLDEN/perf.actual"
+        ec=$?
+    set -e
+    # the hardware counters may well be unavailable, but the VM's own count never is
+    if [ "$ec" != 0 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec)"
+        success=$((success + 1))
+    elif ! diff "$GOLDEN/hello-joy.expected" "$GOLDEN/hello-joy.actual"; then
+        echo >&2 "[FAIL] actual output does not match expected"
+        success=$((success + 1))
+    elif ! grep -q '^\[PERF\] [1-9][0-9]* VM instructions$' "$GOLDEN/perf.actual"; then
+        echo >&2 "[FAIL] no VM instruction count"
+        success=$((success + 1))
+    fi
+
 
     echo >&2 "sponge.bS"
     set +e
@@ -94,5 +227,204 @@ success=0
         success=$((success + 1))
     fi
 
+    echo >&2 "sponge.bS --record, then --replay"
+    log="$(mktemp)"
+    set +e
+        $BSVM --record "$log" ./sponge.bsvm < "$GOLDEN/sponge.expected" > "$GOLDEN/sponge.actual"
+        ec=$?
+        # the input comes from the log, and the output is only checksummed
+        [ "$ec" = 0 ] && $BSVM --replay "$log" ./sponge.bsvm < /dev/null 2> "$GOLDEN/sponge-replay.actual" > /dev/null
+        ec=$?
+    set -e
+    rm -f "$log"
+    if [ "$ec" != 0 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec)"
+        success=$((success + 1))
+    elif ! diff "$GOLDEN/sponge-replay.expected" "$GOLDEN/sponge-replay.actual"; then
+        echo >&2 "[FAIL] actual output does not match expected"
+        success=$((success + 1))
+    fi
+
+    for heap in libc pool; do
+        echo >&2 "sponge.bS --heap $heap"
+        set +e
+            $BSVM --heap $heap ./sponge.bsvm < "$GOLDEN/sponge.expected" > "$GOLDEN/sponge.actual"
+            ec=$?
+        set -e
+        if [ "$ec" != 0 ]; then
+            echo >&2 "[FAIL] unexpected error code ($ec)"
+            success=$((success + 1))
+        elif ! diff "$GOLDEN/sponge.expected" "$GOLDEN/sponge.actual"; then
+            echo >&2 "[FAIL] actual output does not match expected"
+            success=$((success + 1))
+        fi
+
+        echo >&2 "leak.bS --heap $heap --heap-stats"
+        set +e
+            $BSVM --heap $heap --heap-stats ./leak.bsvm 2> "$GOLDEN/leak.actual"
+            ec=$?
+        set -e
+        if [ "$ec" != 0 ]; then
+            echo >&2 "[FAIL] unexpected error code ($ec)"
+            success=$((success + 1))
+        elif ! diff "$GOLDEN/leak.expected" "$GOLDEN/leak.actual"; then
+            echo >&2 "[FAIL] actual output does not match expected"
+            success=$((success + 1))
+        fi
+    done
+
+    for kind in uring threads; do
+        for gc in "" --gc; do
+            echo >&2 "aio.bS --aio $kind $gc"
+            file="$(mktemp)"
+            set +e
+                $BSVM --aio $kind $gc ./aio.bsvm "$file"
+                ec=$?
+            set -e
+            rm -f "$file"
+            if [ "$ec" != 0 ]; then
+                echo >&2 "[FAIL] unexpected error code ($ec)"
+                success=$((success + 1))
+            fi
+        done
+    done
+
+    echo >&2 "pipeline.bS"
+    name="/bsvm-pipeline-$$"
+    set +e
+        $BSVM ./pipeline.bsvm init "$name"
+        ec=$?
+        if [ "$ec" = 0 ]; then
+            $BSVM ./pipeline.bsvm send "$name" &
+            sender=$!
+            $BSVM ./pipeline.bsvm receive "$name"
+            ec=$?
+            wait "$sender" || ec=$?
+        fi
+    set -e
+    if [ "$ec" != 0 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec)"
+        success=$((success + 1))
+    fi
+
+    for heap in libc pool; do
+        echo >&2 "garbage.bS --heap $heap --gc --heap-stats"
+        set +e
+            $BSVM --heap $heap --gc --heap-stats ./garbage.bsvm 2> "$GOLDEN/garbage.actual"
+            ec=$?
+        set -e
+        # some 10 MB of it is garbage, which must not all be live at once
+        peak="$(sed -n 's/^\[HEAP\] .* \([0-9]*\) bytes peak$/\1/p' "$GOLDEN/garbage.actual")"
+        if [ "$ec" != 0 ]; then
+            echo >&2 "[FAIL] unexpected error code ($ec)"
+            success=$((success + 1))
+        elif [ -z "$peak" ] || [ "$peak" -gt 2000000 ]; then
+            echo >&2 "[FAIL] garbage was not collected (peak: $peak bytes)"
+            success=$((success + 1))
+        fi
+    done
+
+    for heap in libc pool; do
+        echo >&2 "snapshot.bS --heap $heap"
+        image="$(mktemp)"
+        set +e
+            $BSVM --heap $heap --snapshot "$image" ./snapshot.bsvm
+            ec=$?
+        set -e
+        if [ "$ec" != 0 ]; then
+            echo >&2 "[FAIL] unexpected error code when saving ($ec)"
+            success=$((success + 1))
+        fi
+        for gc in "" --gc; do
+            set +e
+                $BSVM --heap $heap $gc --restore "$image" > "$GOLDEN/snapshot.actual"
+                ec=$?
+            set -e
+            if [ "$ec" != 216 ]; then
+                echo >&2 "[FAIL] unexpected error code when restoring $gc ($ec), expecting 216"
+                success=$((success + 1))
+            elif ! diff "$GOLDEN/snapshot.expected" "$GOLDEN/snapshot.actual"; then
+                echo >&2 "[FAIL] actual output does not match expected"
+                success=$((success + 1))
+            fi
+        done
+        rm "$image"
+    done
+
+    echo >&2 "factorial.bS (bsvm-aot)"
+    ../scripts/bsvm-aot.py ./factorial.bsvm -o ./factorial.aot
+    set +e
+        ./factorial.aot
+        ec=$?
+    set -e
+    if [ "$ec" != 120 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec), expecting 120"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "hello.bS Joy (bsvm-aot)"
+    ../scripts/bsvm-aot.py ./hello.bsvm -o ./hello.aot
+    set +e
+        ./hello.aot Joy > "$GOLDEN/hello-joy.actual"
+        ec=$?
+    set -e
+    if [ "$ec" != 0 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec)"
+        success=$((success + 1))
+    elif ! diff "$GOLDEN/hello-joy.expected" "$GOLDEN/hello-joy.actual"; then
+        echo >&2 "[FAIL] actual output does not match expected"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "sponge.bS (bsvm-aot)"
+    ../scripts/bsvm-aot.py ./sponge.bsvm -o ./sponge.aot
+    set +e
+        ./sponge.aot < "$GOLDEN/sponge.expected" > "$GOLDEN/sponge.actual"
+        ec=$?
+    set -e
+    if [ "$ec" != 0 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec)"
+        success=$((success + 1))
+    elif ! diff "$GOLDEN/sponge.expected" "$GOLDEN/sponge.actual"; then
+        echo >&2 "[FAIL] actual output does not match expected"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "embed.c"
+    set +e
+        ./embed > "$GOLDEN/embed.actual"
+        ec=$?
+    set -e
+    if [ "$ec" != 0 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec)"
+        success=$((success + 1))
+    elif ! diff "$GOLDEN/embed.expected" "$GOLDEN/embed.actual"; then
+        echo >&2 "[FAIL] actual output does not match expected"
+        success=$((success + 1))
+    fi
+
+    echo >&2 "hello.bS Joy --serve"
+    sockdir="$(mktemp -d)"
+    $BSVM --serve "$sockdir/sock" &
+    server=$!
+    tries=0
+    while [ ! -S "$sockdir/sock" ] && [ "$tries" -lt 50 ]; do
+        sleep 0.1
+        tries=$((tries + 1))
+    done
+    set +e
+        ../bin/bsvmc --socket "$sockdir/sock" ./hello.bsvm Joy > "$GOLDEN/hello-joy.actual"
+        ec=$?
+    set -e
+    kill "$server"
+    rm -r "$sockdir"
+    if [ "$ec" != 0 ]; then
+        echo >&2 "[FAIL] unexpected error code ($ec)"
+        success=$((success + 1))
+    elif ! diff "$GOLDEN/hello-joy.expected" "$GOLDEN/hello-joy.actual"; then
+        echo >&2 "[FAIL] actual output does not match expected"
+        success=$((success + 1))
+    fi
+
 
 exit "$success"
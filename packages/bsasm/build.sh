@@ -7,12 +7,21 @@ cd "$HERE"
 
 BSASM=../../scripts/bsasm.py
 BIN="./bin"
+OBJ="$BIN/obj"
 LIB=../stdlib/src
 SRC=./src
-"$BSASM" \
+
+# Each file is assembled to an object only when it (or the assembler) has
+# changed since its object was made. Once one is reassembled, so is everything
+# after it, since later files may use the constants it defines.
+mkdir -p "$OBJ"
+objs=""
+stale=""
+for src in \
     "$LIB/isa.bS" \
     "$LIB/Ascii.bS" \
     "$LIB/Print.bS" \
+    "$LIB/Arena.bS" \
     "$LIB/ByteSlice.bS" \
     "$LIB/ByteBuf.bS" \
     "$LIB/ArrayBuf.bS" \
@@ -22,7 +31,14 @@ SRC=./src
     "$SRC/strings.bS" \
     "$SRC/debug.bS" \
     "$SRC/main.bS"
+do
+    obj="$OBJ/$(basename "$src" .bS).bso"
+    if [ -n "$stale" ] || [ ! -f "$obj" ] || [ "$src" -nt "$obj" ] || [ "$BSASM" -nt "$obj" ]; then
+        "$BSASM" -c $objs "$src" -o "$obj"
+        stale=1
+    fi
+    objs="$objs $obj"
+done
 
-mkdir -p "$BIN"
-mv "$SRC/main.bsvm" "$BIN/bsasm"
+"$BSASM" $objs -o "$BIN/bsasm"
 chmod +x "$BIN/bsasm"
@@ -13,7 +13,7 @@ OUTPUT=./files
 
 LIB=../src
 STDLIB=""
-for lib in isa Print Ascii ByteSlice ByteBuf ArrayBuf; do
+for lib in isa Print Ascii ByteSlice ByteBuf ArrayBuf Arena BigNat HashMap File Ring; do
     STDLIB="$STDLIB $LIB/$lib.bS"
 done
 
@@ -22,7 +22,7 @@ if [ "$1" = "--valgrind" ]; then
     shift
 fi
 if [ "$#" = 0 ]; then
-    suites="Print Ascii ByteSlice ByteBuf ArrayBuf"
+    suites="Print Ascii ByteSlice ByteBuf ArrayBuf Arena BigNat HashMap File Ring"
 else
     suites=$@
 fi
@@ -1,49 +1,212 @@
 #!/usr/bin/env python3
 
+import json
 import sys
 import re
 from os import path
 
+# Assemble `.bS` files into a bsvm executable, named after the last input.
+#
+# Each source file is assembled on its own into an object: its code, the labels
+# it defines, the constants it `.def`ines, and fixups for the jump offsets and
+# such that refer to labels in other files. Linking concatenates the objects in
+# order and applies the fixups. Constants carry over from one file to the next,
+# as if they were all one file.
+#
+# Data (from `.ascii`) goes in a read-only data section after all the code,
+# starting on a fresh page, so that code stays dense. A label is placed with the
+# data or code that follows it, except that labels straight after data, with
+# no instruction in between, mark the end of that data. Each run of data is a
+# block; identical blocks, wherever they come from, are only stored once. The
+# data follows the code in the executable, after a "BsvmRod1" marker, the
+# offset from the start of the code to load it at, and its size.
+#
+# With `-c`, each source file's object is written out (as a `.bso`) instead of
+# linking. Objects may also be given as inputs: when linking, they are linked
+# in that position; when compiling, they supply the constants that source files
+# after them need, so unchanged objects never need to be reassembled.
+
 def main():
-  # FIXME not every argument is a file name
-  asm = Asm()
+  compileOnly = False
+  output = None
+  inputs = []
+  args = sys.argv[1:]
+  while args:
+    if args[0] == "-c":
+      compileOnly = True
+    elif args[0] == "-o" and len(args) > 1:
+      output = args[1]
+      args = args[1:]
+    else:
+      inputs.append(args[0])
+    args = args[1:]
+  if not inputs or (compileOnly and output is not None and sum(1 for f in inputs if not isObject(f)) != 1):
+    print("usage: bsasm.py [-o <executable>] <file.bS|file.bso>...\n"
+          "       bsasm.py -c [-o <object>] [<file.bso>...] <file.bS>...", file=sys.stderr)
+    exit(1)
+  consts = dict()
+  objs = []
   try:
-    for fname in sys.argv[1:]:
-      with open(fname, "rt") as fp:
-        asm.file = fname
-        asm.lineno = 0
-        for line in fp.readlines():
-          asm.asmLine(line)
-    asm.finalize_function()
-    for listener in asm.rewrites.values():
-      for off, stuff in listener.items():
-        size, endianness, expr = stuff
-        try:
-          val = expr(asm)
-        except ForwardReference as exn:
-          name, _ = exn.args
-          raise AsmExn("undefined label: {}".format(name))
-        asm.code[off:off+size] = val.to_bytes(size, endianness, signed=True)
-        if callable(asm.entrypoint):
-          asm.entrypoint = asm.entrypoint(asm)
+    for fname in inputs:
+      if isObject(fname):
+        obj = Object.read(fname)
+      else:
+        obj = assemble(fname, consts)
+        if compileOnly:
+          obj.write(output or path.splitext(fname)[0] + ".bso")
+      consts.update(obj.consts)
+      objs.append(obj)
+    if compileOnly:
+      return
+    shebang, entrypoint, code, rodataAt, rodata = link(objs)
   except AsmExn as exn:
-    print("{} line {}: {}".format(asm.file, asm.lineno, exn), file=sys.stderr)
+    print(exn, file=sys.stderr)
     exit(1)
-  with open(path.splitext(fname)[0] + ".bsvm", "wb") as fp:
-    if asm.shebang is not None:
-      fp.write(b"#!" + asm.shebang.encode('ascii') + b"\n")
+  with open(output or path.splitext(inputs[-1])[0] + ".bsvm", "wb") as fp:
+    if shebang is not None:
+      fp.write(b"#!" + shebang.encode('ascii') + b"\n")
     fp.write(b"BsvmExe1")
-    fp.write(len(asm.code).to_bytes(4, 'big'))
-    fp.write((asm.entrypoint or 0).to_bytes(4, 'big'))
-    fp.write(asm.code)
+    fp.write(len(code).to_bytes(4, 'big'))
+    fp.write(entrypoint.to_bytes(4, 'big'))
+    fp.write(code)
+    if rodata:
+      fp.write(b"BsvmRod1")
+      fp.write(rodataAt.to_bytes(4, 'big'))
+      fp.write(len(rodata).to_bytes(4, 'big'))
+      fp.write(rodata)
+
+PAGE_BYTES = 4096
+
+def isObject(fname):
+  return fname.endswith(".bso")
+
+def assemble(fname, consts):
+  asm = Asm(consts)
+  asm.file = fname
+  try:
+    with open(fname, "rt") as fp:
+      for line in fp.readlines():
+        asm.asmLine(line)
+    asm.finalize_function()
+    return asm.finalize_object()
+  except OSError as exn:
+    raise AsmExn("{}: {}".format(fname, exn.strerror))
+  except AsmExn as exn:
+    raise AsmExn("{} line {}: {}".format(asm.file, asm.lineno, exn))
+
+def link(objs):
+  """Lay the objects out one after another, returning the shebang, entrypoint,
+  and code of the executable."""
+  labels = dict()
+  consts = dict()
+  bases = []
+  code = bytearray(b"")
+  def define(obj, name, addr):
+    if name in labels:
+      raise AsmExn("{}: duplicate label {}".format(obj.file, repr(name)))
+    labels[name] = addr
+  for obj in objs:
+    bases.append(len(code))
+    for name, off in obj.labels.items():
+      define(obj, name, len(code) + off)
+    consts.update(obj.consts)
+    code += obj.code
+  # the data is loaded at the next page after the code; all of it is bytes, so
+  # nothing needs more alignment than that
+  rodataAt = (len(code) + PAGE_BYTES - 1) // PAGE_BYTES * PAGE_BYTES
+  rodata = bytearray(b"")
+  placed = dict()
+  for obj in objs:
+    blocks = []
+    for block in obj.rodata:
+      if block not in placed:
+        placed[block] = rodataAt + len(rodata)
+        rodata += block
+      blocks.append(placed[block])
+    for name, (block, off) in obj.rodataLabels.items():
+      define(obj, name, blocks[block] + off)
+  shebang, entrypoint = None, None
+  for obj, base in zip(objs, bases):
+    for off, size, endianness, tree, lineno in obj.fixups:
+      val = evalLinked(tree, labels, consts, base, obj.file, lineno)
+      code[base+off:base+off+size] = val.to_bytes(size, endianness, signed=True)
+    if obj.shebang is not None:
+      if shebang is not None:
+        raise AsmExn("{}: shebang is already specified".format(obj.file))
+      shebang = obj.shebang
+    if obj.entrypoint is not None:
+      if entrypoint is not None:
+        raise AsmExn("{}: duplicate entrypoint definition".format(obj.file))
+      entrypoint = evalLinked(obj.entrypoint, labels, consts, base, obj.file, None)
+  return shebang, entrypoint or 0, code, rodataAt, rodata
+
+def evalLinked(tree, labels, consts, base, file, lineno):
+  where = file if lineno is None else "{} line {}".format(file, lineno)
+  try:
+    return evalExpr(tree, labels, consts, base)
+  except ForwardReference as exn:
+    raise AsmExn("{}: undefined label: {}".format(where, exn.args[0]))
+  except EvalExn as exn:
+    raise AsmExn("{}: {}".format(where, exn))
+
+class Object:
+  """The assembled code of one source file, with what is needed to link it."""
+  FORMAT = "BsvmObj1"
+  def __init__(self, file):
+    self.file = file
+    self.code = bytearray(b"")
+    self.labels = dict() # Map[LabelName, Offset]
+    self.rodata = [] # List[bytes], one per block of data
+    self.rodataLabels = dict() # Map[LabelName, (BlockIndex, Offset)]
+    self.consts = dict() # Map[ConstName, Value], just those defined in the file
+    self.fixups = [] # List[(Offset, Size, Endianness, Expr tree, LineNo)]
+    self.entrypoint = None # ?Expr tree
+    self.shebang = None
+
+  def write(self, fname):
+    with open(fname, "wt") as fp:
+      json.dump({
+        "format": Object.FORMAT,
+        "file": self.file,
+        "code": self.code.hex(),
+        "labels": self.labels,
+        "rodata": [block.hex() for block in self.rodata],
+        "rodataLabels": self.rodataLabels,
+        "consts": self.consts,
+        "fixups": self.fixups,
+        "entrypoint": self.entrypoint,
+        "shebang": self.shebang,
+      }, fp)
+  @staticmethod
+  def read(fname):
+    try:
+      with open(fname, "rt") as fp:
+        data = json.load(fp)
+    except OSError as exn:
+      raise AsmExn("{}: {}".format(fname, exn.strerror))
+    except ValueError:
+      data = None
+    if not isinstance(data, dict) or data.get("format") != Object.FORMAT:
+      raise AsmExn("{}: not a bsasm object file".format(fname))
+    obj = Object(data["file"])
+    obj.code = bytearray.fromhex(data["code"])
+    obj.labels = data["labels"]
+    obj.rodata = [bytes.fromhex(block) for block in data["rodata"]]
+    obj.rodataLabels = {name: tuple(at) for name, at in data["rodataLabels"].items()}
+    obj.consts = data["consts"]
+    obj.fixups = [tuple(fixup) for fixup in data["fixups"]]
+    obj.entrypoint = data["entrypoint"]
+    obj.shebang = data["shebang"]
+    return obj
 
 class AsmExn(Exception):
   pass
 
 class Asm:
-  def __init__(self):
+  def __init__(self, consttab):
     self.lbltab = dict()
-    self.consttab = dict()
+    self.consttab = dict(consttab)
+    self.defined = dict()
     self.regtab = None
     self.numGlobals = 0
     # info about current location
@@ -58,7 +221,11 @@ class Asm:
     self.shebang = None
     self.entrypoint = None
     self.code = bytearray(b"")
-    self.rewrites = dict() # Map[WaitOnLabelName, Map[Offset, Expr]] # FIXME store line number also
+    self.rodata = [] # blocks of data, as bytearrays
+    self.rodataLabels = dict() # Map[LabelName, (BlockIndex, Offset)]
+    self.lastEmitted = None # 'code' or 'data'
+    self.unplaced = [] # labels that have yet to see what follows them
+    self.rewrites = dict() # Map[WaitOnLabelName, Map[Offset, (Size, Endianness, Expr, LineNo)]]
 
   def asmLine(self, line):
     self.lineno += 1
@@ -88,9 +255,24 @@ class Asm:
     # add to label table
     self.add_label(lblname)
   def add_label(self, lblname):
-    if lblname in self.lbltab:
+    if lblname in self.lbltab or lblname in self.rodataLabels:
       raise AsmExn("duplicate label {}".format(repr(lblname)))
-    self.lbltab[lblname] = self.offset
+    # until something follows, guess that the label goes with what came before
+    if self.lastEmitted == 'data':
+      self.rodataLabels[lblname] = (len(self.rodata) - 1, len(self.rodata[-1]))
+    else:
+      self.lbltab[lblname] = self.offset
+    self.unplaced.append(lblname)
+  def place_labels(self, kind):
+    """Move the labels just seen to the start of the code or data that follows."""
+    for lblname in self.unplaced:
+      if kind == 'code' and lblname in self.rodataLabels:
+        del self.rodataLabels[lblname]
+        self.lbltab[lblname] = self.offset
+      elif kind == 'data' and lblname in self.lbltab:
+        del self.lbltab[lblname]
+        self.rodataLabels[lblname] = (len(self.rodata) - 1, len(self.rodata[-1]))
+    self.unplaced = []
 
 
   def asmDirective(self, line):
@@ -116,16 +298,48 @@ class Asm:
       f(*args)
     except TypeError:
       raise AsmExn("incorrect number of arguments to {}: {}".format(opcode, len(args)))
+    except ForwardReference as exn:
+      raise AsmExn("label {} is not yet defined in this file, as it must be here".format(exn.args[0]))
 
   def append(self, code):
+    self.place_labels('code')
+    self.lastEmitted = 'code'
     self.code += code
     self.offset += len(code)
+  def append_data(self, data):
+    if self.lastEmitted != 'data':
+      self.rodata.append(bytearray(b""))
+    self.place_labels('data')
+    self.lastEmitted = 'data'
+    self.rodata[-1] += data
   def suspend(self, waitOn, expr, *, size=4, endianness='big'):
     if waitOn not in  self.rewrites:
       self.rewrites[waitOn] = dict()
-    self.rewrites[waitOn][self.offset] = (size, endianness, expr)
+    self.rewrites[waitOn][self.offset] = (size, endianness, expr, self.lineno)
     self.append((0).to_bytes(size, 'big'))
-  # TODO fill placeholder
+  def finalize_object(self):
+    """Fill in what references to this file's labels can be, leaving the rest
+    as fixups for the linker."""
+    obj = Object(self.file)
+    for listener in self.rewrites.values():
+      for off, (size, endianness, expr, lineno) in listener.items():
+        try:
+          val = expr(self)
+        except ForwardReference:
+          obj.fixups.append((off, size, endianness, expr.tree, lineno))
+          continue
+        except EvalExn as exn:
+          self.lineno = lineno
+          raise AsmExn(exn)
+        self.code[off:off+size] = val.to_bytes(size, endianness, signed=True)
+    obj.code = self.code
+    obj.labels = self.lbltab
+    obj.rodata = [bytes(block) for block in self.rodata]
+    obj.rodataLabels = self.rodataLabels
+    obj.consts = self.defined
+    obj.entrypoint = self.entrypoint
+    obj.shebang = self.shebang
+    return obj
 
   def arg(self, text, allow):
     # print("{} :: {}".format(repr(text), type(text)))
@@ -142,8 +356,20 @@ class Asm:
         e = self.parseExpr(text)
       except ParseExn as exn:
         raise AsmExn("parse error: {}".format(*exn.args))
-      return 'i', e(self)
+      try:
+        val = e(self)
+      except EvalExn as exn:
+        raise AsmExn(*exn.args)
+      # immediates are varints, so there is no patching them once linked
+      if isinstance(val, CodeAddr) and 'a' not in allow:
+        raise AsmExn("the address of {} is only known once linked; use it relative to an instruction (as lia does) or take the difference of two labels".format(repr(val.name)))
+      return 'i', val
     raise AsmExn("bad argument (expecting {}): {}".format(allow, repr(text)))
+  def relative(self, addr, instrAddr):
+    """The offset from an instruction to an address in this file."""
+    if isinstance(addr, CodeAddr):
+      return addr.off - instrAddr
+    return addr - instrAddr
   def finalize_function(self):
     if self.functionAddr is not None:
       self.code[self.functionAddr:self.functionAddr+4] \
@@ -156,11 +382,11 @@ class Asm:
   def DIR_entrypoint(self, args):
     if self.entrypoint is not None:
       raise AsmExn("duplicate entrypoint definition")
+    # labels move when linked, so this is only worked out then
     try:
-      self.entrypoint = self.arg(args, 'i')
-    except ForwardReference as exn:
-      _, expr = exn.args
-      self.entrypoint = expr
+      self.entrypoint = self.parseExpr(args).tree
+    except ParseExn as exn:
+      raise AsmExn("parse error: {}".format(*exn.args))
   def DIR_global(self, args):
     for arg in [arg.strip(), args.split(',')]:
       if not re.match(r"", arg):
@@ -180,6 +406,8 @@ class Asm:
     # define function name/label
     if re.match(r"^[a-zA-Z0-9._-]+$", name):
       self.functionName = name
+      # labels between data and a function mark the end of the data
+      self.unplaced = []
       self.add_label(name)
     else:
       raise AsmExn("bad function name: {}".format(name))
@@ -219,6 +447,7 @@ class Asm:
     body = args[len(name):].strip()
     _, value = self.arg(body, 'i')
     self.consttab[name] = value
+    self.defined[name] = value
   def DIR_ascii(self, args):
     text = ""
     while True:
@@ -241,7 +470,7 @@ class Asm:
         else:
           break
       raise AsmExn("invalid ascii syntax: {}".format(repr(args)))
-    self.append(text.encode('ascii'))
+    self.append_data(text.encode('ascii'))
 
   def OP_hcf(self):
     self.append(b"\x00")
@@ -268,27 +497,50 @@ class Asm:
   def OP_stg(self, a, b): self.op_imm_reg(a, b, 0x09)
   def OP_lea(self, a, b): self.op_reg_reg(a, b, 0x0A)
   def OP_lia(self, a, b): self.op_reg_off(a, b, opcode=0x0B)
-  def OP_ldb(self, a, b): self.op_reg_reg(a, b, 0x0C)
-  # 0x0D
-  def OP_stb(self, a, b): self.op_reg_reg(a, b, 0x0E)
-  # 0x0F
+  def OP_ldb(self, a, b, c=None):
+    _, dst = self.arg(a, 'r')
+    _, src = self.arg(b, 'r')
+    if c is None:
+      self.append(0x0C.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src))
+    else:
+      _, imm = self.arg(c, 'i')
+      self.append(0x0D.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src) + mkVarint(imm))
+  def OP_stb(self, a, b, c=None):
+    _, dst = self.arg(a, 'r')
+    if c is None:
+      _, src = self.arg(b, 'r')
+      self.append(0x0E.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src))
+    else:
+      _, imm = self.arg(b, 'i')
+      _, src = self.arg(c, 'r')
+      self.append(0x0F.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(imm) + mkVarint(src))
   ###### Arithmetic ######
   def OP_add(self, a, b): self.op_reg_regimm(a, b, whenReg=0x10, whenImm=0x11)
   def OP_sub(self, a, b): self.op_reg_regimm(a, b, whenReg=0x12, whenImm=0x13)
   def OP_adc(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x14)
-  # 0x15
+  def OP_dvw(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x15)
   def OP_sbb(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x16)
   def OP_neg(self, a, b): self.op_reg_reg(a, b, 0x17)
   def OP_mul(self, a, b): self.op_reg_reg(a, b, 0x18)
-  def OP_muc(self, a, b, c): op_reg_reg_reg(a, b, c, 0x19)
+  def OP_muc(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x19)
   def OP_imul(self, a, b): self.op_reg_reg(a, b, 0x1A)
-  def OP_imuc(self, a, b, c): op_reg_reg_reg(a, b, c, 0x1B)
+  def OP_imuc(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x1B)
   def OP_div(self, a, b): self.op_reg_reg(a, b, 0x1C)
-  def OP_dvr(self, a, b, c): op_reg_reg_reg(a, b, c, 0x1D)
+  def OP_dvr(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x1D)
   def OP_idiv(self, a, b): self.op_reg_reg(a, b, 0x1E)
-  def OP_idvr(self, a, b, c): op_reg_reg_reg(a, b, c, 0x1F)
+  def OP_idvr(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x1F)
   ###### Bit Fiddling ######
   # 0x20–0x2F
+  def OP_popc(self, a, b): self.op_reg_reg(a, b, 0x20)
+  def OP_clz(self, a, b): self.op_reg_reg(a, b, 0x21)
+  def OP_ctz(self, a, b): self.op_reg_reg(a, b, 0x22)
+  def OP_bswp(self, a, b): self.op_reg_reg(a, b, 0x23)
+  def OP_pext(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x24)
+  def OP_pdep(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x25)
+  def OP_sel(self, a, b, c, d): self.op_reg_reg_reg_reg(a, b, c, d, 0x26)
+  def OP_bfx(self, a, b, c, d): self.op_reg_reg_imm_imm(a, b, c, d, 0x27)
+  def OP_bfi(self, a, b, c, d): self.op_reg_reg_imm_imm(a, b, c, d, 0x28)
+  # 0x29–0x2F
   def OP_or(self, a, b): self.op_reg_regimm(a, b, whenReg=0x30, whenImm=0x31)
   def OP_xor(self, a, b): self.op_reg_regimm(a, b, whenReg=0x32, whenImm=0x33)
   def OP_and(self, a, b): self.op_reg_regimm(a, b, whenReg=0x34, whenImm=0x35)
@@ -304,9 +556,10 @@ class Asm:
     _, src = self.arg(a, 'r')
     self.append(b"\x41" + mkVarint(src))
   def OP_rnew(self, a, b): self.op_reg_reg(a, b, 0x42)
-  # 0x43
+  def OP_arena(self, a, b): self.op_reg_reg(a, b, 0x43)
   def OP_off(self, a, b): self.op_reg_regimm(a, b, whenReg=0x44, whenImm=0x45)
-  # 0x46 - 0x47
+  def OP_anew(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x46)
+  def OP_afree(self, a, b): self.op_imm_reg(a, b, 0x47)
   def OP_mmov(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0x48)
   # 0x49 - 0x4D
   def OP_meq(self, a, b, c, d): self.op_reg_reg_reg_reg(a, b, c, d, 0x4E)
@@ -332,24 +585,28 @@ class Asm:
   ###### Conditioned Operations ######
   def OP_cmov(self, a, b, c): self.op_reg_reg_regimm(a, b, c, whenReg=0x60, whenImm=0x61)
   def OP_zmov(self, a, b, c): self.op_reg_reg_regimm(a, b, c, whenReg=0x62, whenImm=0x63)
-  # 0x65–0x6F
+  def OP_cld(self, a, b, c, d=None): self.op_cond_ld(a, b, c, d, 0x64)
+  def OP_zld(self, a, b, c, d=None): self.op_cond_ld(a, b, c, d, 0x66)
+  def OP_cst(self, a, b, c, d=None): self.op_cond_st(a, b, c, d, 0x68)
+  def OP_zst(self, a, b, c, d=None): self.op_cond_st(a, b, c, d, 0x6A)
+  # 0x6C–0x6F
   ###### Jumps ######
   def OP_jmpr(self, a):
     _, src = self.arg(a, 'r')
     self.append(b"\x70" + mkVarint(src))
   def OP_jmp(self, a):
     try:
-      _, imm = self.arg(a, 'i')
+      _, imm = self.arg(a, 'ia')
       fref = None
     except ForwardReference as exn:
       fref, expr = exn.args
     if fref is None:
-      imm -= self.offset
+      imm = self.relative(imm, self.offset)
       self.append(b"\x71" + imm.to_bytes(4, 'big', signed=True))
     else:
       instrAddr = self.offset
       self.append(b"\x71")
-      self.suspend(fref, lambda asm: expr(asm) - instrAddr)
+      self.suspend(fref, Expr(['-', expr.tree, ['here', instrAddr]]))
   def OP_cjmp(self, a, b): self.op_reg_off(a, b, opcode=0x72)
   def OP_zjmp(self, a, b): self.op_reg_off(a, b, opcode=0x73)
   # 0x74–7F
@@ -361,6 +618,72 @@ class Asm:
   def OP_exit(self, a):
     _, src = self.arg(a, 'r')
     self.append(b"\x86" + mkVarint(src))
+  def OP_snap(self, a):
+    _, dst = self.arg(a, 'r')
+    self.append(b"\x87" + mkVarint(dst))
+  ###### Sized Memory Access ######
+  # format byte: log2 of size in bytes | 4 if sign-extending | 8 if big-endian
+  def OP_ld8s(self, a, b, c=None): self.op_ldx(a, b, c, 0x04)
+  def OP_ld16(self, a, b, c=None): self.op_ldx(a, b, c, 0x01)
+  def OP_ld16s(self, a, b, c=None): self.op_ldx(a, b, c, 0x05)
+  def OP_ld16be(self, a, b, c=None): self.op_ldx(a, b, c, 0x09)
+  def OP_ld16sbe(self, a, b, c=None): self.op_ldx(a, b, c, 0x0D)
+  def OP_ld32(self, a, b, c=None): self.op_ldx(a, b, c, 0x02)
+  def OP_ld32s(self, a, b, c=None): self.op_ldx(a, b, c, 0x06)
+  def OP_ld32be(self, a, b, c=None): self.op_ldx(a, b, c, 0x0A)
+  def OP_ld32sbe(self, a, b, c=None): self.op_ldx(a, b, c, 0x0E)
+  def OP_ld64(self, a, b, c=None): self.op_ldx(a, b, c, 0x03)
+  def OP_ld64be(self, a, b, c=None): self.op_ldx(a, b, c, 0x0B)
+  def OP_st16(self, a, b, c=None): self.op_stx(a, b, c, 0x01)
+  def OP_st16be(self, a, b, c=None): self.op_stx(a, b, c, 0x09)
+  def OP_st32(self, a, b, c=None): self.op_stx(a, b, c, 0x02)
+  def OP_st32be(self, a, b, c=None): self.op_stx(a, b, c, 0x0A)
+  def OP_st64(self, a, b, c=None): self.op_stx(a, b, c, 0x03)
+  def OP_st64be(self, a, b, c=None): self.op_stx(a, b, c, 0x0B)
+  ###### Multi-word Arithmetic ######
+  def OP_adcn(self, a, b, c, d): self.op_reg_reg_reg_reg(a, b, c, d, 0x94)
+  def OP_sbbn(self, a, b, c, d): self.op_reg_reg_reg_reg(a, b, c, d, 0x95)
+  def OP_macn(self, a, b, c, d, e): self.op_reg_reg_reg_reg_reg(a, b, c, d, e, 0x96)
+  def OP_divn(self, a, b, c, d, e): self.op_reg_reg_reg_reg_reg(a, b, c, d, e, 0x97)
+  ###### Hashing ######
+  def OP_hash(self, a, b, c, d): self.op_reg_reg_reg_reg(a, b, c, d, 0x98)
+  ###### Numbers ######
+  # padded with zeros, or with spaces for the -sp forms
+  def OP_fmtu(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x00)
+  def OP_fmti(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x02)
+  def OP_fmtx(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x01)
+  def OP_fmtix(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x03)
+  def OP_fmtusp(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x04)
+  def OP_fmtisp(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x06)
+  def OP_fmtxsp(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x05)
+  def OP_fmtixsp(self, a, b, c, d): self.op_fmt(a, b, c, d, 0x07)
+  def OP_parsu(self, a, b, c, d): self.op_pars(a, b, c, d, 0x00)
+  def OP_parsi(self, a, b, c, d): self.op_pars(a, b, c, d, 0x02)
+  def OP_parsx(self, a, b, c, d): self.op_pars(a, b, c, d, 0x01)
+  def OP_parsix(self, a, b, c, d): self.op_pars(a, b, c, d, 0x03)
+  ###### Sorting ######
+  # records are one word, keyed on itself, unless a stride and key are given
+  def OP_sort(self, a, b, c=1, d=0): self.op_sort(0x9B, 0x00, [a, b], c, d)
+  def OP_sorts(self, a, b, c=1, d=0): self.op_sort(0x9B, 0x01, [a, b], c, d)
+  def OP_bsearch(self, a, b, c, d, e=1, f=0): self.op_sort(0x9C, 0x00, [a, b, c, d], e, f)
+  def OP_bsearchs(self, a, b, c, d, e=1, f=0): self.op_sort(0x9C, 0x01, [a, b, c, d], e, f)
+  def OP_merge(self, a, b, c, d, e, f=1, g=0): self.op_sort(0x9D, 0x00, [a, b, c, d, e], f, g)
+  def OP_merges(self, a, b, c, d, e, f=1, g=0): self.op_sort(0x9D, 0x01, [a, b, c, d, e], f, g)
+  ###### Vectors ######
+  # a vector is held in 16 / sizeof(word) consecutive registers
+  def OP_vld(self, a, b): self.op_reg_reg(a, b, 0xA0)
+  def OP_vst(self, a, b): self.op_reg_reg(a, b, 0xA1)
+  def OP_vspl(self, a, b): self.op_reg_reg(a, b, 0xA2)
+  def OP_veq(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xA3)
+  def OP_vbl(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xA4)
+  def OP_vadd(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xA5)
+  def OP_vsub(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xA6)
+  def OP_vand(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xA7)
+  def OP_vor(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xA8)
+  def OP_vxor(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xA9)
+  def OP_vshuf(self, a, b, c): self.op_reg_reg_reg(a, b, c, 0xAA)
+  def OP_vmsk(self, a, b): self.op_reg_reg(a, b, 0xAB)
+  def OP_vsum(self, a, b): self.op_reg_reg(a, b, 0xAC)
   ###### String Operations ######
   ###### Environment Access ######
   def OP_strm(self, a, b): self.op_reg_imm(a, b, opcode=0xC0)
@@ -376,7 +699,22 @@ class Asm:
   def OP_flus(self, a, b): self.op_reg_reg(a, b, 0xD7)
   def OP_tell(self, a, b): self.op_reg_reg(a, b, 0xD8)
   def OP_seek(self, a, b, c): self.op_imm_reg_reg(a, b, c, 0xD9)
-  # 0xD9–0xDF
+  def OP_aget(self, a, b, c, d, e, f): self.op_nregs((a, b, c, d, e, f), 0xDA)
+  def OP_aput(self, a, b, c, d, e, f): self.op_nregs((a, b, c, d, e, f), 0xDB)
+  def OP_await(self, a, b, c): self.op_nregs((a, b, c), 0xDC)
+  def OP_apoll(self, a, b, c): self.op_nregs((a, b, c), 0xDD)
+  # 0xDE–0xDF
+  ###### Shared Memory ######
+  def OP_shm(self, a, b, c, d):
+    _, mode = self.arg(a, 'i')
+    regs = b"".join(mkVarint(self.arg(r, 'r')[1]) for r in (b, c, d))
+    self.append((0xE0).to_bytes(1, 'big') + mkVarint(mode) + regs)
+  def OP_unshm(self, a, b): self.op_reg_reg(a, b, opcode=0xE1)
+  def OP_shmrm(self, a, b): self.op_reg_reg(a, b, opcode=0xE2)
+  def OP_wait(self, a, b): self.op_reg_reg(a, b, opcode=0xE3)
+  def OP_wake(self, a, b): self.op_reg_reg(a, b, opcode=0xE4)
+  def OP_lda(self, a, b): self.op_reg_reg(a, b, opcode=0xE5)
+  def OP_sta(self, a, b): self.op_reg_reg(a, b, opcode=0xE6)
   ###### Done wth Opcodes ######
 
   def op_reg(self, a, opcode):
@@ -427,6 +765,59 @@ class Asm:
       self.append(whenReg.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src) + mkVarint(amt))
     elif aType == 'i':
       self.append(whenImm.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src) + mkVarint(amt))
+  def op_cond_ld(self, a, b, c, d, opcode):
+    _, cond = self.arg(a, 'r')
+    _, dst = self.arg(b, 'r')
+    _, src = self.arg(c, 'r')
+    if d is None:
+      self.append(opcode.to_bytes(1, 'big') + mkVarint(cond) + mkVarint(dst) + mkVarint(src))
+    else:
+      _, imm = self.arg(d, 'i')
+      self.append((opcode + 1).to_bytes(1, 'big') + mkVarint(cond) + mkVarint(dst) + mkVarint(src) + mkVarint(imm))
+  def op_cond_st(self, a, b, c, d, opcode):
+    _, cond = self.arg(a, 'r')
+    _, dst = self.arg(b, 'r')
+    if d is None:
+      _, src = self.arg(c, 'r')
+      self.append(opcode.to_bytes(1, 'big') + mkVarint(cond) + mkVarint(dst) + mkVarint(src))
+    else:
+      _, imm = self.arg(c, 'i')
+      _, src = self.arg(d, 'r')
+      self.append((opcode + 1).to_bytes(1, 'big') + mkVarint(cond) + mkVarint(dst) + mkVarint(imm) + mkVarint(src))
+  def op_ldx(self, a, b, c, fmt):
+    _, dst = self.arg(a, 'r')
+    _, src = self.arg(b, 'r')
+    if c is None:
+      self.append(b"\x90" + fmt.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src))
+    else:
+      _, imm = self.arg(c, 'i')
+      self.append(b"\x91" + fmt.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src) + mkVarint(imm))
+  def op_stx(self, a, b, c, fmt):
+    _, dst = self.arg(a, 'r')
+    if c is None:
+      _, src = self.arg(b, 'r')
+      self.append(b"\x92" + fmt.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(src))
+    else:
+      _, imm = self.arg(b, 'i')
+      _, src = self.arg(c, 'r')
+      self.append(b"\x93" + fmt.to_bytes(1, 'big') + mkVarint(dst) + mkVarint(imm) + mkVarint(src))
+  def op_fmt(self, a, b, c, d, fmt):
+    regs = [self.arg(x, 'r')[1] for x in (a, b, c, d)]
+    self.append(b"\x99" + fmt.to_bytes(1, 'big') + b"".join(mkVarint(r) for r in regs))
+  def op_pars(self, a, b, c, d, fmt):
+    regs = [self.arg(x, 'r')[1] for x in (a, b, c, d)]
+    self.append(b"\x9A" + fmt.to_bytes(1, 'big') + b"".join(mkVarint(r) for r in regs))
+  def op_sort(self, opcode, fmt, regs, stride, key):
+    regs = [self.arg(x, 'r')[1] for x in regs]
+    _, stride = self.arg(stride, 'i') if isinstance(stride, str) else ('i', stride)
+    _, key = self.arg(key, 'i') if isinstance(key, str) else ('i', key)
+    self.append(opcode.to_bytes(1, 'big') + fmt.to_bytes(1, 'big') + b"".join(mkVarint(r) for r in regs) + mkVarint(stride) + mkVarint(key))
+  def op_reg_reg_imm_imm(self, a, b, c, d, opcode):
+    _, r1 = self.arg(a, 'r')
+    _, r2 = self.arg(b, 'r')
+    _, i3 = self.arg(c, 'i')
+    _, i4 = self.arg(d, 'i')
+    self.append(opcode.to_bytes(1, 'big') + mkVarint(r1) + mkVarint(r2) + mkVarint(i3) + mkVarint(i4))
   def op_reg_reg_reg_reg(self, a, b, c, d, opcode):
     _, r1 = self.arg(a, 'r')
     _, r2 = self.arg(b, 'r')
@@ -434,6 +825,15 @@ class Asm:
     _, r4 = self.arg(d, 'r')
     self.append(opcode.to_bytes(1, 'big') + mkVarint(r1) + mkVarint(r2) + mkVarint(r3) + mkVarint(r4))
 
+  def op_reg_reg_reg_reg_reg(self, a, b, c, d, e, opcode):
+    _, r1 = self.arg(a, 'r')
+    _, r2 = self.arg(b, 'r')
+    _, r3 = self.arg(c, 'r')
+    _, r4 = self.arg(d, 'r')
+    _, r5 = self.arg(e, 'r')
+    self.append(opcode.to_bytes(1, 'big') + mkVarint(r1) + mkVarint(r2) + mkVarint(r3) + mkVarint(r4) + mkVarint(r5))
+  def op_nregs(self, args, opcode):
+    self.append(opcode.to_bytes(1, 'big') + b"".join(mkVarint(self.arg(a, 'r')[1]) for a in args))
   def op_regs(self, *args, opcode):
     n = len(args)
     srcs = [self.arg(a ,'r')[1] for a in args]
@@ -452,20 +852,20 @@ class Asm:
   def op_reg_off(self, a, b, opcode):
     _, dst = self.arg(a, 'r')
     try:
-      _, imm = self.arg(b, 'i')
+      _, imm = self.arg(b, 'ia')
       fref = None
     except ForwardReference as exn:
       fref, expr = exn.args
     if fref is None:
-      imm -= self.offset
+      imm = self.relative(imm, self.offset)
       self.append(opcode.to_bytes(1, 'big') + mkVarint(dst) + imm.to_bytes(4, 'big', signed=True))
     else:
       instrAddr = self.offset
       self.append(opcode.to_bytes(1, 'big') + mkVarint(dst))
-      self.suspend(fref, lambda asm: expr(asm) - instrAddr)
+      self.suspend(fref, Expr(['-', expr.tree, ['here', instrAddr]]))
   def op_regoff_regs(self, a, *bs, whenReg, whenOff):
     try:
-      ty, val = self.arg(a, 'ri')
+      ty, val = self.arg(a, 'ria')
       fref = None
     except ForwardReference as exn:
       ty = 'i'
@@ -478,9 +878,9 @@ class Asm:
       instrAddr = self.offset
       self.append(whenOff.to_bytes(1, 'big'))
       if fref is None:
-        self.append((val - instrAddr).to_bytes(4, 'big', signed=True))
+        self.append(self.relative(val, instrAddr).to_bytes(4, 'big', signed=True))
       else:
-        self.suspend(fref, lambda asm: expr(asm) - instrAddr)
+        self.suspend(fref, Expr(['-', expr.tree, ['here', instrAddr]]))
     self.append(mkVarint(n))
     for src in srcs:
       self.append(mkVarint(src))
@@ -510,13 +910,13 @@ class Asm:
         e2 = takeSum()
         if e2 is None:
           raise ParseExn("missing sum after plus")
-        return lambda asm: e(asm) + e2(asm)
+        return ['+', e, e2]
       op = takeKeyword("-")
       if op is not None:
         e2 = takeSum()
         if e2 is None:
           raise ParseExn("missing sum after minus")
-        return lambda asm: e(asm) - e2(asm)
+        return ['-', e, e2]
       return e
     def takeTerm():
       nonlocal toks
@@ -527,7 +927,7 @@ class Asm:
         e2 = takeTerm()
         if e2 is None:
           raise ParseExn("missing expression after times")
-        return lambda asm: e(asm) + e2(asm)
+        return ['*', e, e2]
       return e
     def takeExpr():
       nonlocal toks
@@ -560,21 +960,14 @@ class Asm:
       else:
         return None
       toks = toks[1:]
-      return lambda asm: tok
+      return ['int', tok]
     def takeVar():
       nonlocal toks
       if not toks: return None
       tok = toks[0]
       if re.match(r"^\$[a-zA-Z0-9._-]+$", tok):
-        name = tok[1:]
         toks = toks[1:]
-        def out(asm):
-          nonlocal name
-          try:
-            return asm.consttab[name]
-          except KeyError:
-            raise EvalExn("undefined constant {}".format(name))
-        return out
+        return ['const', tok[1:]]
     def takeLabel():
       nonlocal toks
       if not toks: return None
@@ -588,29 +981,131 @@ class Asm:
         toks = toks[1:]
       else:
         return None
-      def out(asm):
-        nonlocal name, wholeExpr
-        try:
-          return asm.lbltab[name]
-        except KeyError:
-          raise ForwardReference(name, wholeExpr)
-      return out
-    wholeExpr = takeSum()
-    if wholeExpr is None:
+      return ['label', name]
+    tree = takeSum()
+    if tree is None:
       raise ParseExn("invalid expression")
     if toks:
       raise ParseExn("extra tokens: {}".format(toks))
-    return wholeExpr
+    return Expr(tree)
+
+class Expr:
+  """A parsed expression, as a tree of lists that can be saved in an object:
+    ['int', n], ['const', name], ['label', name],
+    ['here', offset] (an offset into the file being assembled),
+    or [op, left, right] where op is '+', '-' or '*'.
+  Call it to evaluate it before linking."""
+  def __init__(self, tree):
+    self.tree = tree
+  def __call__(self, asm):
+    try:
+      val = evalExpr(self.tree, FileLabels(asm), asm.consttab, CodeAddr('here', 0))
+    except ForwardReference as exn:
+      raise ForwardReference(exn.args[0], self)
+    if isinstance(val, RodataAddr):
+      raise ForwardReference(val.name, self)
+    return val
+
+class FileLabels:
+  """The labels of the file being assembled, for evalExpr. Where the file's
+  code and data will end up is not known until it is linked, so code labels
+  evaluate to CodeAddrs, and data labels to RodataAddrs."""
+  def __init__(self, asm):
+    self.asm = asm
+  def __getitem__(self, name):
+    if name in self.asm.lbltab:
+      return CodeAddr(name, self.asm.lbltab[name])
+    block, off = self.asm.rodataLabels[name]
+    return RodataAddr(name, block, off)
+
+class RodataAddr:
+  """An address in a block of data, before linking: offsets can be added to it,
+  and it can be subtracted from another address in the same block. Anything
+  else will have to wait until link time."""
+  def __init__(self, name, block, off):
+    self.name, self.block, self.off = name, block, off
+  def __add__(self, n):
+    if not isinstance(n, int):
+      raise ForwardReference(self.name)
+    return RodataAddr(self.name, self.block, self.off + n)
+  __radd__ = __add__
+  def __sub__(self, other):
+    if isinstance(other, RodataAddr):
+      if other.block != self.block:
+        raise ForwardReference(self.name)
+      return self.off - other.off
+    if not isinstance(other, int):
+      raise ForwardReference(self.name)
+    return RodataAddr(self.name, self.block, self.off - other)
+  def __rsub__(self, n):
+    raise ForwardReference(self.name)
+  def __mul__(self, n):
+    raise ForwardReference(self.name)
+  __rmul__ = __mul__
+
+class CodeAddr:
+  """An address in the code of the file being assembled, before linking: an
+  offset from the start of the file. Offsets can be added to it, and another
+  address in the file subtracted from it, giving a plain number; the address
+  itself is only known once linked."""
+  def __init__(self, name, off):
+    self.name, self.off = name, off
+  def __add__(self, n):
+    if isinstance(n, RodataAddr):
+      raise ForwardReference(n.name)
+    if not isinstance(n, int):
+      raise EvalExn("cannot add two addresses")
+    return CodeAddr(self.name, self.off + n)
+  __radd__ = __add__
+  def __sub__(self, other):
+    if isinstance(other, CodeAddr):
+      return self.off - other.off
+    if isinstance(other, RodataAddr):
+      raise ForwardReference(other.name)
+    return CodeAddr(self.name, self.off - other)
+  def __rsub__(self, n):
+    raise EvalExn("cannot subtract an address from a number")
+  def __mul__(self, n):
+    raise EvalExn("cannot multiply an address")
+  __rmul__ = __mul__
+
+def evalExpr(tree, labels, consts, base):
+  """Evaluate an expression tree, where the file's code starts at base.
+  Raises ForwardReference(name) for an unknown label."""
+  tag = tree[0]
+  if tag == 'int':
+    return tree[1]
+  elif tag == 'const':
+    try:
+      return consts[tree[1]]
+    except KeyError:
+      raise EvalExn("undefined constant {}".format(tree[1]))
+  elif tag == 'label':
+    try:
+      return labels[tree[1]]
+    except KeyError:
+      raise ForwardReference(tree[1])
+  elif tag == 'here':
+    return base + tree[1]
+  left = evalExpr(tree[1], labels, consts, base)
+  right = evalExpr(tree[2], labels, consts, base)
+  if tag == '+':
+    return left + right
+  elif tag == '-':
+    return left - right
+  elif tag == '*':
+    return left * right
+  raise EvalExn("bad expression: {}".format(tree))
 
 def mkVarint(n):
-  negative = n < 0
-  if negative: n = -n
+  # big-endian groups of seven bits, two's complement, where bit 6 of the
+  # first byte gives the sign
   out = b""
-  while n >= 0x40:
+  while True:
     n, b = n >> 7, n & 0x7f
     out = (b + (0x80 if out else 0)).to_bytes(1, 'big') + out
-  out = ((0x80 if out else 0) + (0x40 if negative else 0) + n).to_bytes(1, 'big') + out
-  return out
+    if (n == 0 and not b & 0x40) or (n == -1 and b & 0x40):
+      return out
 
 class ParseExn(Exception):
   pass
@@ -0,0 +1,360 @@
+#!/usr/bin/env python3
+
+# Compile a bsvm executable ahead-of-time into a native one.
+#
+# Every instruction reachable from the entrypoint (or from a `LIA`, since it
+# might be taken as a function pointer) becomes a labelled call to the same
+# opcode function the interpreter uses, so there is nothing to keep in sync.
+# What goes away is the fetch-and-dispatch: each instruction falls straight
+# through to the next, and jumps whose targets are in the code go directly to
+# their label. Most opcode functions only read their operands and then work on
+# registers; for those, a copy taking the operands as arguments is made from
+# the function's own source, and each call passes the decoded operands as
+# constants, so the C compiler sees exactly which registers are used. Targets only known at runtime (`JMPR`, `JALR`, `JARR`, `RET`) go
+# through a computed-goto table indexed by code offset. Any offset not in that
+# table is handed to the interpreter until it returns to known code, which
+# keeps even odd programs (jumping into data, say) working as they would
+# under `bsvm`.
+#
+# The instruction formats come from the ISA documentation in
+# src/execute/opcodes.c (as parsed by extract-opcode-docs.py), and the opcode
+# function names from the normal dispatch table in src/execute.c. The native binary
+# links libbsvm as its runtime, so build that (`./build.sh`) first.
+
+import argparse
+import importlib.util
+import os
+from os import path
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = path.join(path.dirname(path.realpath(__file__)), "..")
+SRC = path.join(ROOT, "src")
+LIB = path.join(ROOT, "bin", "libbsvm.a")
+
+
+def main():
+  parser = argparse.ArgumentParser(description="compile a bsvm executable to a native one")
+  parser.add_argument("input", help="bytecode file (.bsvm)")
+  parser.add_argument("-o", dest="output", help="native executable to write")
+  parser.add_argument("--emit-c", dest="emit_c", help="also keep the generated C source here")
+  parser.add_argument("--cc", default=os.environ.get("CC", "gcc"), help="C compiler (default: $CC or gcc)")
+  args = parser.parse_args()
+  if args.output is None and args.emit_c is None:
+    parser.error("nothing to do: give -o and/or --emit-c")
+
+  try:
+    code, entrypoint, codeEnd = readProgram(args.input)
+  except AotExn as exn:
+    print("[ERROR] {}: {}".format(args.input, exn), file=sys.stderr)
+    sys.exit(1)
+  isa, includes = loadIsa()
+  instrs = disassemble(code, codeEnd, entrypoint, isa)
+  source = generate(code, entrypoint, instrs, isa, includes)
+
+  if args.emit_c is not None:
+    with open(args.emit_c, "wt") as fp:
+      fp.write(source)
+  if args.output is not None:
+    with tempfile.NamedTemporaryFile("wt", suffix=".c") as fp:
+      fp.write(source)
+      fp.flush()
+      cmd = [args.cc, "-std=c11", "-O2", "-I", SRC, fp.name, LIB, "-pthread", "-o", args.output]
+      res = subprocess.run(cmd)
+      if res.returncode != 0:
+        sys.exit(res.returncode)
+
+
+class AotExn(Exception):
+  pass
+
+
+def readProgram(filename):
+  with open(filename, "rb") as fp:
+    data = fp.read()
+  if data.startswith(b"#!"):
+    nl = data.find(b"\n")
+    if nl < 0:
+      raise AotExn("unterminated shebang line")
+    data = data[nl+1:]
+  if data[:8] != b"BsvmExe1":
+    raise AotExn("not a bsvm executable")
+  size = int.from_bytes(data[8:12], 'big')
+  entrypoint = int.from_bytes(data[12:16], 'big')
+  code = data[16:16+size]
+  if len(code) != size or entrypoint + 4 > size:
+    raise AotExn("truncated executable")
+  rest = data[16+size:]
+  if not rest:
+    return code, entrypoint, size
+  # the read-only data is loaded at the given offset, past the code
+  if rest[:8] != b"BsvmRod1" or len(rest) < 16:
+    raise AotExn("bad read-only data section")
+  offset = int.from_bytes(rest[8:12], 'big')
+  rodata = rest[16:16+int.from_bytes(rest[12:16], 'big')]
+  if offset < size or len(rodata) != int.from_bytes(rest[12:16], 'big'):
+    raise AotExn("bad read-only data section")
+  return code + bytes(offset - size) + rodata, entrypoint, size
+
+
+###### Instruction Set ######
+
+# How control leaves each instruction that might not simply fall through.
+#   'stop': halts the machine
+#   'jump': always to `offset`
+#   'branch': either to `offset` or falls through
+#   'call': to the function at `offset`, later returning just after the call
+#   'tail': to the function at `offset`, never to return here
+#   'dynamic': somewhere only known at runtime
+#   'dynamic-call': as 'dynamic', but returning just after the call
+CONTROL = {
+  0x00: 'stop',
+  0x70: 'dynamic',
+  0x71: 'jump',
+  0x72: 'branch',
+  0x73: 'branch',
+  0x80: 'dynamic-call',
+  0x81: 'call',
+  0x82: 'dynamic',
+  0x83: 'tail',
+  0x84: 'dynamic',
+  0x86: 'stop',
+}
+# Instructions whose `offset` is an address that may be taken as a function.
+ADDRESS = {0x0B}
+
+OPERAND = re.compile(r"^(?:(\w+) \* )?(r|reg|imm|i32|byte|word)<([^>]*)>$")
+
+def loadIsa():
+  spec = importlib.util.spec_from_file_location("opdocs", path.join(ROOT, "scripts", "extract-opcode-docs.py"))
+  opdocs = importlib.util.module_from_spec(spec)
+  spec.loader.exec_module(opdocs)
+  isa = dict()
+  with open(path.join(SRC, "execute", "opcodes.c"), "rt") as fp:
+    for doc in opdocs.loop(fp):
+      operands = []
+      for arg in doc['args']:
+        if not arg:
+          continue
+        m = OPERAND.match(arg)
+        if not m:
+          raise AotExn("can't understand operand {} of {} {}".format(repr(arg), doc['opcode'], doc['mnemonic']))
+        count, mode, name = m.groups()
+        operands.append((count, 'r' if mode == 'reg' else mode, name))
+      isa[int(doc['opcode'], 0)] = {'mnemonic': doc['mnemonic'], 'operands': operands}
+  # the normal dispatch table names the function implementing each opcode
+  with open(path.join(SRC, "execute.c"), "rt") as fp:
+    text = fp.read()
+  for m in re.finditer(r"^\s*\[(0x[0-9A-Fa-f]+)\] = (\w+),", text, re.M):
+    opcode = int(m.group(1), 0)
+    if opcode in isa:
+      isa[opcode]['function'] = m.group(2)
+  # the opcode functions need whatever the interpreter includes before them
+  includes = re.findall(r'^#include "(?!execute/opcodes\.c)[^"]+"$', text, re.M)
+  with open(path.join(SRC, "execute", "opcodes.c"), "rt") as fp:
+    text = fp.read()
+  for op in isa.values():
+    if 'function' in op:
+      op['decoded'] = decodedBody(text, op)
+  return isa, includes
+
+OPERAND_READ = re.compile(r"^  (\w+) (\w+) = read(?:Varint|I32)\(&self->ip\);\n", re.M)
+
+def decodedBody(text, op):
+  """Return the parameters and body of the opcode's function with its operand
+  reads taken out, or None unless that leaves a body that needs nothing else
+  from the instruction stream: it reads each operand once, up front, and
+  neither touches `ip` nor hands the machine to anything that might."""
+  m = re.search(r"^void {}\(Machine\* self\) \{{\n(.*?)^\}}".format(op['function']), text, re.M | re.S)
+  if m is None or any(count is not None for count, _, _ in op['operands']):
+    return None
+  body = m.group(1)
+  params = []
+  while True:
+    read = OPERAND_READ.match(body)
+    if read is None:
+      break
+    params.append((read.group(1), read.group(2)))
+    body = body[read.end():]
+  if len(params) != len(op['operands']) or "self->ip" in body or re.search(r"\w\(self\b", body):
+    return None
+  return params, body
+
+def decode(code, at, isa):
+  """Decode the instruction at `at`, returning (opcode, length, {operand name: value}),
+  or None if there is no valid instruction there."""
+  if at >= len(code) or code[at] not in isa or 'function' not in isa[code[at]]:
+    return None
+  opcode = code[at]
+  values = dict()
+  ip = at + 1
+  try:
+    for count, mode, name in isa[opcode]['operands']:
+      n = 1 if count is None else values[count]
+      for _ in range(n):
+        if mode in ('r', 'imm'):
+          value, ip = readVarint(code, ip)
+        elif mode == 'i32':
+          if ip + 4 > len(code):
+            return None
+          value = int.from_bytes(code[ip:ip+4], 'big', signed=True)
+          ip += 4
+        elif mode == 'byte':
+          value = code[ip]
+          ip += 1
+        elif mode == 'word':
+          raise AotExn("word-sized operands depend on the target")
+        if count is None:
+          values[name] = value
+  except IndexError:
+    return None
+  return opcode, ip - at, values
+
+def readVarint(code, ip):
+  out = -1 if code[ip] & 0x40 else 0
+  while True:
+    b = code[ip]
+    ip += 1
+    out = (out << 7) + (b & 0x7F)
+    if not b & 0x80:
+      return out, ip
+
+
+###### Translation ######
+
+def disassemble(code, codeEnd, entrypoint, isa):
+  """Find every instruction reachable from the entrypoint, never looking past
+  `codeEnd` into the read-only data.
+  Returns a dict from code offset to (opcode, length, target or None, operands)."""
+  instrs = dict()
+  todo = [entrypoint + 4]
+  while todo:
+    at = todo.pop()
+    if at in instrs or not 0 <= at < codeEnd:
+      continue
+    res = decode(code, at, isa)
+    if res is None:
+      continue
+    opcode, length, values = res
+    control = CONTROL.get(opcode)
+    target = None
+    if 'offset' in values:
+      target = at + values['offset']
+      if control in ('call', 'tail'):
+        # skip the word giving the callee's frame size
+        target += 4
+      if opcode in ADDRESS:
+        # it might be data; if not, the code proper comes after the frame size
+        todo.extend([target, target + 4])
+        target = None
+      else:
+        todo.append(target)
+    instrs[at] = (opcode, length, target, list(values.values()))
+    if control not in ('stop', 'jump', 'tail', 'dynamic'):
+      todo.append(at + length)
+  return instrs
+
+def constant(value):
+  """A C literal for a decoded operand, wrapping as the interpreter's decoding would."""
+  if -2**31 <= value < 2**31:
+    return str(value)
+  return "{}ll".format(value) if -2**63 <= value < 2**63 else "{}ull".format(value % 2**64)
+
+def generate(code, entrypoint, instrs, isa, includes):
+  out = []
+  emit = out.append
+  emit("// Generated by scripts/bsvm-aot.py; do not edit.")
+  emit("")
+  for include in includes:
+    emit(include)
+  emit('#include "execute/opcodes.c"')
+  emit("")
+  for opcode in sorted({instrs[at][0] for at in instrs}):
+    decoded = isa[opcode]['decoded']
+    if decoded is None:
+      continue
+    params, body = decoded
+    emit("static inline")
+    emit("void {}Decoded(Machine* self{}) {{".format(isa[opcode]['function'], "".join(", {} {}".format(t, n) for t, n in params)))
+    out.extend(body.rstrip("\n").split("\n"))
+    emit("}")
+    emit("")
+  emit("#define CODE_BYTES {}".format(len(code)))
+  emit("#define ENTRYPOINT {}".format(entrypoint))
+  # read-only, as the loader would make it (the call cache relies on that)
+  emit("static const byte codeBytes[CODE_BYTES] = {")
+  for i in range(0, len(code), 16):
+    emit("  " + " ".join("0x{:02x},".format(b) for b in code[i:i+16]))
+  emit("};")
+  emit("static byte* const code = (byte*)codeBytes;")
+  emit("")
+  emit("static void run(Machine* self) {")
+  emit("  static void* const labels[CODE_BYTES] = {")
+  for at in sorted(instrs):
+    emit("    [{0}] = &&L{0},".format(at))
+  emit("  };")
+  emit("  goto dispatch;")
+  offsets = sorted(instrs)
+  for i, at in enumerate(offsets):
+    opcode, length, target, operands = instrs[at]
+    control = CONTROL.get(opcode)
+    decoded = isa[opcode]['decoded']
+    emit("L{}: // {}".format(at, isa[opcode]['mnemonic']))
+    if decoded is None:
+      emit("  self->ip = code + {};".format(at + 1))
+      emit("  {}(self);".format(isa[opcode]['function']))
+    else:
+      args = "".join(", " + constant(v) for v in operands)
+      emit("  {}Decoded(self{});".format(isa[opcode]['function'], args))
+    if control in ('stop', 'dynamic', 'dynamic-call'):
+      if decoded is not None:
+        emit("  self->ip = code + {};".format(at + length))
+      emit("  goto dispatch;")
+      continue
+    if control is not None:
+      emit("  if (self->shouldHalt) { return; }")
+    if target not in instrs and control in ('branch', 'jump', 'call', 'tail'):
+      # the target could not be decoded, so leave it to the interpreter
+      emit("  goto dispatch;")
+      continue
+    if control == 'branch':
+      emit("  if (self->ip == code + {0}) {{ goto L{0}; }}".format(target))
+    elif control in ('jump', 'call', 'tail'):
+      emit("  goto L{};".format(target))
+      continue
+    # fall through
+    after = at + length
+    if i + 1 < len(offsets) and offsets[i + 1] == after:
+      pass
+    elif after in instrs:
+      emit("  goto L{};".format(after))
+    else:
+      if decoded is not None:
+        emit("  self->ip = code + {};".format(after))
+      emit("  goto dispatch;")
+  emit("dispatch:")
+  emit("  while (!self->shouldHalt) {")
+  emit("    size_t at = self->ip - code;")
+  emit("    if (at < CODE_BYTES && labels[at] != NULL) { goto *labels[at]; }")
+  emit("    cycle(self);")
+  emit("  }")
+  emit("}")
+  emit("")
+  emit("int main(int argc, char** argv) {")
+  emit("  Program prog = { .code = code, .codeSize_bytes = CODE_BYTES, .entrypoint = ENTRYPOINT };")
+  emit("  Machine machine;")
+  emit("  if (initMachine(&machine, &prog, argc, argv)) {")
+  emit('    fprintf(stderr, "[ERROR] when initializing machine\\n");')
+  emit("    return -1;")
+  emit("  }")
+  emit("  run(&machine);")
+  emit("  destroyMachine(&machine);")
+  emit("  return machine.exitcode;")
+  emit("}")
+  return "\n".join(out) + "\n"
+
+
+if __name__ == "__main__":
+  main()
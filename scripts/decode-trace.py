@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+
+# Print a trace written by `bsvm --trace` in readable form: one instruction per
+# line, with its code offset and mnemonic, indented by call depth. With
+# `--summary`, print how often each opcode ran instead.
+#
+# See `writeTrace` in src/debug.c for the file format.
+
+import argparse
+import importlib.util
+from os import path
+import sys
+
+ROOT = path.join(path.dirname(path.realpath(__file__)), "..")
+RECORD_BYTES = 12
+
+
+def main():
+  parser = argparse.ArgumentParser(description="decode a bsvm instruction trace")
+  parser.add_argument("trace", help="file written by `bsvm --trace`")
+  parser.add_argument("--summary", action="store_true", help="count executions of each opcode")
+  args = parser.parse_args()
+
+  with open(args.trace, "rb") as fp:
+    data = fp.read()
+  if data[:8] != b"BsvmTrc1":
+    print("[ERROR] {}: not a bsvm trace".format(args.trace), file=sys.stderr)
+    sys.exit(1)
+  total = int.from_bytes(data[8:16], 'little')
+  kept = int.from_bytes(data[16:24], 'little')
+  records = data[24:]
+  if len(records) != kept * RECORD_BYTES:
+    print("[ERROR] {}: truncated trace".format(args.trace), file=sys.stderr)
+    sys.exit(1)
+  mnemonics = loadMnemonics()
+
+  def decode():
+    for i in range(kept):
+      rec = records[i*RECORD_BYTES:(i+1)*RECORD_BYTES]
+      ip = int.from_bytes(rec[0:4], 'little')
+      depth = int.from_bytes(rec[4:8], 'little', signed=True)
+      yield ip, depth, rec[8]
+
+  if args.summary:
+    counts = dict()
+    for _, _, opcode in decode():
+      counts[opcode] = counts.get(opcode, 0) + 1
+    for opcode, count in sorted(counts.items(), key=lambda kv: -kv[1]):
+      print("{:>10} {:02x} {}".format(count, opcode, mnemonics.get(opcode, "???")))
+  else:
+    if kept < total:
+      print("; ... {} earlier instructions not kept".format(total - kept))
+    for ip, depth, opcode in decode():
+      print("{:08x} {}{}".format(ip, "  " * depth, mnemonics.get(opcode, "??? ({:02x})".format(opcode))))
+
+
+def loadMnemonics():
+  spec = importlib.util.spec_from_file_location("opdocs", path.join(ROOT, "scripts", "extract-opcode-docs.py"))
+  opdocs = importlib.util.module_from_spec(spec)
+  spec.loader.exec_module(opdocs)
+  with open(path.join(ROOT, "src", "execute", "opcodes.c"), "rt") as fp:
+    return {int(doc['opcode'], 0): doc['mnemonic'] for doc in opdocs.loop(fp)}
+
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,340 @@
+#define _GNU_SOURCE // for `syscall`
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "aio.h"
+
+
+// Operations waiting for a thread, or finished but not yet taken. Both queues
+// are rings of `AIO_DEPTH`, which is enough since that many can be in flight.
+// An operation is known to the backends by its slot in `AsyncIo.ops`; its tag
+// stays there, so that it can't be confused with another operation's.
+typedef struct AioOp AioOp;
+struct AioOp {
+  bool write;
+  int fd;
+  byte* buf;
+  size_t len;
+  uint64_t off;
+  size_t slot;
+  intptr_t res;
+};
+typedef struct AioRing AioRing;
+struct AioRing {
+  size_t head;
+  size_t len;
+  AioOp at[AIO_DEPTH];
+};
+
+#define AIO_THREAD_COUNT 4
+
+struct AsyncIo {
+  AioKind kind; // never `AIO_AUTO`
+  size_t inflight; // submitted but not yet taken
+  // the operations in flight, by slot
+  struct {
+    bool busy;
+    byte* buf;
+    uintptr_t tag;
+  } ops[AIO_DEPTH];
+  union {
+#ifdef __linux__
+    struct {
+      int fd;
+      void* sqRing;
+      size_t sqRing_bytes;
+      void* cqRing;
+      size_t cqRing_bytes;
+      struct io_uring_sqe* sqes;
+      size_t sqes_bytes;
+      unsigned* sqTail;
+      unsigned* sqMask;
+      unsigned* sqArray;
+      unsigned* cqHead;
+      unsigned* cqTail;
+      unsigned* cqMask;
+      struct io_uring_cqe* cqes;
+    } uring;
+#endif
+    struct {
+      pthread_mutex_t lock;
+      pthread_cond_t hasWork;
+      pthread_cond_t hasDone;
+      bool stopping;
+      size_t started; // threads
+      pthread_t threads[AIO_THREAD_COUNT];
+      AioRing pending;
+      AioRing done;
+    } threads;
+  };
+};
+
+
+////// io_uring //////
+
+#ifdef __linux__
+
+static bool initUring(AsyncIo* self) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, AIO_DEPTH, &p);
+  if (fd < 0) { return false; }
+  self->uring.fd = fd;
+  self->uring.sqRing_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  self->uring.cqRing_bytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  self->uring.sqes_bytes = p.sq_entries * sizeof(struct io_uring_sqe);
+  self->uring.sqRing = mmap(NULL, self->uring.sqRing_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING);
+  self->uring.cqRing = mmap(NULL, self->uring.cqRing_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_CQ_RING);
+  self->uring.sqes = mmap(NULL, self->uring.sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQES);
+  if (self->uring.sqRing == MAP_FAILED || self->uring.cqRing == MAP_FAILED || self->uring.sqes == MAP_FAILED) {
+    if (self->uring.sqRing != MAP_FAILED) { munmap(self->uring.sqRing, self->uring.sqRing_bytes); }
+    if (self->uring.cqRing != MAP_FAILED) { munmap(self->uring.cqRing, self->uring.cqRing_bytes); }
+    if (self->uring.sqes != MAP_FAILED) { munmap(self->uring.sqes, self->uring.sqes_bytes); }
+    close(fd);
+    return false;
+  }
+  byte* sq = self->uring.sqRing;
+  byte* cq = self->uring.cqRing;
+  self->uring.sqTail = (unsigned*)(sq + p.sq_off.tail);
+  self->uring.sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+  self->uring.sqArray = (unsigned*)(sq + p.sq_off.array);
+  self->uring.cqHead = (unsigned*)(cq + p.cq_off.head);
+  self->uring.cqTail = (unsigned*)(cq + p.cq_off.tail);
+  self->uring.cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+  self->uring.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  return true;
+}
+
+static void destroyUring(AsyncIo* self) {
+  munmap(self->uring.sqes, self->uring.sqes_bytes);
+  munmap(self->uring.cqRing, self->uring.cqRing_bytes);
+  munmap(self->uring.sqRing, self->uring.sqRing_bytes);
+  close(self->uring.fd);
+}
+
+static int enterUring(AsyncIo* self, unsigned toSubmit, unsigned minComplete) {
+  unsigned flags = minComplete != 0 ? IORING_ENTER_GETEVENTS : 0;
+  int res;
+  do {
+    res = syscall(__NR_io_uring_enter, self->uring.fd, toSubmit, minComplete, flags, NULL, 0);
+  } while (res < 0 && errno == EINTR);
+  return res;
+}
+
+// Each submission goes to the kernel straight away, so the transfer is under
+// way by the time the instruction finishes.
+static bool submitUring(AsyncIo* self, const AioOp* op) {
+  unsigned tail = *self->uring.sqTail;
+  unsigned ix = tail & *self->uring.sqMask;
+  struct io_uring_sqe* sqe = &self->uring.sqes[ix];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op->write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = op->fd;
+  sqe->addr = (uintptr_t)op->buf;
+  sqe->len = op->len;
+  sqe->off = op->off;
+  sqe->user_data = op->slot;
+  self->uring.sqArray[ix] = ix;
+  __atomic_store_n(self->uring.sqTail, tail + 1, __ATOMIC_RELEASE);
+  if (enterUring(self, 1, 0) != 1) {
+    // take it back; the kernel didn't consume it
+    __atomic_store_n(self->uring.sqTail, tail, __ATOMIC_RELEASE);
+    return false;
+  }
+  return true;
+}
+
+static bool completeUring(AsyncIo* self, bool wait, AioOp* out) {
+  while (true) {
+    unsigned head = *self->uring.cqHead;
+    if (head != __atomic_load_n(self->uring.cqTail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe* cqe = &self->uring.cqes[head & *self->uring.cqMask];
+      out->slot = cqe->user_data;
+      out->res = cqe->res;
+      __atomic_store_n(self->uring.cqHead, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+    if (!wait || enterUring(self, 0, 1) < 0) { return false; }
+  }
+}
+
+#endif
+
+
+////// Threads //////
+
+static void pushOp(AioRing* ring, const AioOp* op) {
+  ring->at[(ring->head + ring->len) % AIO_DEPTH] = *op;
+  ring->len += 1;
+}
+
+static AioOp popOp(AioRing* ring) {
+  AioOp op = ring->at[ring->head];
+  ring->head = (ring->head + 1) % AIO_DEPTH;
+  ring->len -= 1;
+  return op;
+}
+
+static void* aioWorker(void* arg) {
+  AsyncIo* self = arg;
+  pthread_mutex_lock(&self->threads.lock);
+  while (true) {
+    while (!self->threads.stopping && self->threads.pending.len == 0) {
+      pthread_cond_wait(&self->threads.hasWork, &self->threads.lock);
+    }
+    if (self->threads.pending.len == 0) { break; }
+    AioOp op = popOp(&self->threads.pending);
+    pthread_mutex_unlock(&self->threads.lock);
+    ssize_t res = op.write
+                ? pwrite(op.fd, op.buf, op.len, op.off)
+                : pread(op.fd, op.buf, op.len, op.off);
+    op.res = res < 0 ? -errno : res;
+    pthread_mutex_lock(&self->threads.lock);
+    pushOp(&self->threads.done, &op);
+    pthread_cond_signal(&self->threads.hasDone);
+  }
+  pthread_mutex_unlock(&self->threads.lock);
+  return NULL;
+}
+
+static void stopThreads(AsyncIo* self) {
+  pthread_mutex_lock(&self->threads.lock);
+  self->threads.stopping = true;
+  pthread_cond_broadcast(&self->threads.hasWork);
+  pthread_mutex_unlock(&self->threads.lock);
+  for (size_t i = 0; i < self->threads.started; ++i) {
+    pthread_join(self->threads.threads[i], NULL);
+  }
+  pthread_cond_destroy(&self->threads.hasDone);
+  pthread_cond_destroy(&self->threads.hasWork);
+  pthread_mutex_destroy(&self->threads.lock);
+}
+
+static bool initThreads(AsyncIo* self) {
+  pthread_mutex_init(&self->threads.lock, NULL);
+  pthread_cond_init(&self->threads.hasWork, NULL);
+  pthread_cond_init(&self->threads.hasDone, NULL);
+  self->threads.stopping = false;
+  self->threads.started = 0;
+  self->threads.pending.head = self->threads.pending.len = 0;
+  self->threads.done.head = self->threads.done.len = 0;
+  for (; self->threads.started < AIO_THREAD_COUNT; ++self->threads.started) {
+    if (pthread_create(&self->threads.threads[self->threads.started], NULL, aioWorker, self) != 0) {
+      break;
+    }
+  }
+  if (self->threads.started == 0) {
+    stopThreads(self);
+    return false;
+  }
+  return true;
+}
+
+static void submitThreads(AsyncIo* self, const AioOp* op) {
+  pthread_mutex_lock(&self->threads.lock);
+  pushOp(&self->threads.pending, op);
+  pthread_cond_signal(&self->threads.hasWork);
+  pthread_mutex_unlock(&self->threads.lock);
+}
+
+static bool completeThreads(AsyncIo* self, bool wait, AioOp* out) {
+  pthread_mutex_lock(&self->threads.lock);
+  while (wait && self->threads.done.len == 0) {
+    pthread_cond_wait(&self->threads.hasDone, &self->threads.lock);
+  }
+  bool got = self->threads.done.len != 0;
+  if (got) { *out = popOp(&self->threads.done); }
+  pthread_mutex_unlock(&self->threads.lock);
+  return got;
+}
+
+
+////// Interface //////
+
+AsyncIo* newAsyncIo(AioKind kind) {
+  AsyncIo* self = malloc(sizeof(AsyncIo));
+  if (self == NULL) { return NULL; }
+  self->inflight = 0;
+  for (size_t i = 0; i < AIO_DEPTH; ++i) { self->ops[i].busy = false; }
+#ifdef __linux__
+  if (kind != AIO_THREADS) {
+    self->kind = AIO_URING;
+    if (initUring(self)) { return self; }
+  }
+#endif
+  self->kind = AIO_THREADS;
+  if (kind != AIO_URING && initThreads(self)) { return self; }
+  free(self);
+  return NULL;
+}
+
+void destroyAsyncIo(AsyncIo* self) {
+  if (self == NULL) { return; }
+  uintptr_t tag;
+  intptr_t res;
+  while (aioComplete(self, true, &tag, &res)) {}
+  switch (self->kind) {
+#ifdef __linux__
+    case AIO_URING: destroyUring(self); break;
+#endif
+    default: stopThreads(self); break;
+  }
+  free(self);
+}
+
+bool aioSubmit(AsyncIo* self, bool write, FILE* file, byte* buf, size_t len, uint64_t off, uintptr_t tag) {
+  if (self->inflight == AIO_DEPTH) { return false; }
+  size_t slot = 0;
+  while (self->ops[slot].busy) { ++slot; }
+  AioOp op = { .write = write, .fd = fileno(file), .buf = buf, .len = len, .off = off, .slot = slot, .res = 0 };
+  switch (self->kind) {
+#ifdef __linux__
+    case AIO_URING: {
+      if (!submitUring(self, &op)) { return false; }
+    } break;
+#endif
+    default: submitThreads(self, &op); break;
+  }
+  self->ops[slot].busy = true;
+  self->ops[slot].buf = buf;
+  self->ops[slot].tag = tag;
+  self->inflight += 1;
+  return true;
+}
+
+bool aioComplete(AsyncIo* self, bool wait, uintptr_t* tag, intptr_t* res) {
+  if (self->inflight == 0) { return false; }
+  AioOp op;
+  bool got;
+  switch (self->kind) {
+#ifdef __linux__
+    case AIO_URING: got = completeUring(self, wait, &op); break;
+#endif
+    default: got = completeThreads(self, wait, &op); break;
+  }
+  if (!got) { return false; }
+  self->inflight -= 1;
+  self->ops[op.slot].busy = false;
+  *tag = self->ops[op.slot].tag;
+  *res = op.res;
+  return true;
+}
+
+size_t aioInflight(const AsyncIo* self, word* out) {
+  size_t len = 0;
+  for (size_t i = 0; i < AIO_DEPTH; ++i) {
+    if (!self->ops[i].busy) { continue; }
+    out[len++].bptr = self->ops[i].buf;
+    out[len++].bits = self->ops[i].tag;
+  }
+  return len;
+}
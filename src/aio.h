@@ -0,0 +1,46 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include "common.h"
+
+
+// A queue of asynchronous reads and writes, behind `AGET`/`APUT`/`AWAIT`/`APOLL`.
+//
+// Each operation transfers bytes between a buffer and a file descriptor at an
+// explicit offset, as `pread`/`pwrite` would, and is identified by a tag the
+// program chose. Completions come back in whatever order they finish, each
+// with its tag and result: the number of bytes transferred, or a negated errno.
+//
+// On Linux, the queue is an io_uring if the kernel will give us one. Otherwise
+// (or if asked to), a few threads make the blocking calls instead.
+
+typedef enum AioKind {
+  AIO_AUTO, // io_uring when available, else threads
+  AIO_URING,
+  AIO_THREADS,
+} AioKind;
+
+// At most this many operations can be in flight at once.
+#define AIO_DEPTH 64
+
+typedef struct AsyncIo AsyncIo;
+
+// Return NULL when the requested kind of queue can't be had.
+AsyncIo* newAsyncIo(AioKind kind);
+// Wait for every operation still in flight, then release the queue.
+void destroyAsyncIo(AsyncIo* self);
+
+// Start a transfer to or from the file's descriptor. Return false if the queue
+// is full.
+bool aioSubmit(AsyncIo* self, bool write, FILE* file, byte* buf, size_t len, uint64_t off, uintptr_t tag);
+// Take one finished operation, waiting for one if `wait` is set. Return false
+// when there is none: nothing is in flight, or (when not waiting) nothing has
+// finished yet.
+bool aioComplete(AsyncIo* self, bool wait, uintptr_t* tag, intptr_t* res);
+// Store the buffer and then the tag of every operation in flight in `out`,
+// which must have room for `2 * AIO_DEPTH` words, and return how many words
+// that came to. (The garbage collector keeps them alive with this.)
+size_t aioInflight(const AsyncIo* self, word* out);
+
+
+#endif
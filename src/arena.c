@@ -0,0 +1,80 @@
+#include "arena.h"
+
+
+static const size_t defaultChunk_bytes = 4096;
+
+static bool growArena(Heap* heap, Arena* self, size_t atLeast_bytes) {
+  size_t cap = self->chunk == NULL ? defaultChunk_bytes : self->chunk->cap_bytes;
+  if (self->chunk != NULL || cap < atLeast_bytes) {
+    // no request so big that doubling, or adding the header, would overflow
+    do {
+      if (cap > SIZE_MAX / 2) { return false; }
+      cap *= 2;
+    } while (cap < atLeast_bytes);
+  }
+  if (cap > SIZE_MAX - sizeof(ArenaChunk)) { return false; }
+  ArenaChunk* chunk = heapAlloc(heap, sizeof(ArenaChunk) + cap, self->site);
+  if (chunk == NULL) { return false; }
+  chunk->prev = self->chunk;
+  chunk->cap_bytes = cap;
+  self->chunk = chunk;
+  self->next = chunk->data;
+  self->end = chunk->data + cap;
+  return true;
+}
+
+// Create an empty arena.
+// The first chunk is allocated eagerly when `cap_bytes` is non-zero.
+Arena* newArena(Heap* heap, size_t cap_bytes, uintptr_t site) {
+  Arena* self = heapAlloc(heap, sizeof(Arena), site);
+  if (self == NULL) { return NULL; }
+  self->chunk = NULL;
+  self->next = NULL;
+  self->end = NULL;
+  self->site = site;
+  if (cap_bytes != 0 && !growArena(heap, self, cap_bytes)) {
+    heapFree(heap, self);
+    return NULL;
+  }
+  return self;
+}
+
+// Allocate memory aligned as strictly as `malloc` would.
+// Returns NULL when out of memory.
+void* arenaAlloc(Heap* heap, Arena* self, size_t size_bytes) {
+  const size_t align = _Alignof(max_align_t);
+  size_t rounded = (size_bytes + align - 1) & ~(align - 1);
+  if (rounded < size_bytes) { return NULL; } // overflow
+  if ((size_t)(self->end - self->next) < rounded) {
+    if (!growArena(heap, self, rounded)) { return NULL; }
+  }
+  byte* out = self->next;
+  self->next += rounded;
+  return out;
+}
+
+// Invalidate everything allocated so far, but keep the largest chunk around
+// for the next round of allocations.
+void resetArena(Heap* heap, Arena* self) {
+  if (self->chunk == NULL) { return; }
+  ArenaChunk* keep = self->chunk;
+  ArenaChunk* old = keep->prev;
+  while (old != NULL) {
+    ArenaChunk* prev = old->prev;
+    heapFree(heap, old);
+    old = prev;
+  }
+  keep->prev = NULL;
+  self->next = keep->data;
+  self->end = keep->data + keep->cap_bytes;
+}
+
+void destroyArena(Heap* heap, Arena* self) {
+  ArenaChunk* chunk = self->chunk;
+  while (chunk != NULL) {
+    ArenaChunk* prev = chunk->prev;
+    heapFree(heap, chunk);
+    chunk = prev;
+  }
+  heapFree(heap, self);
+}
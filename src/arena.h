@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common.h"
+#include "heap.h"
+
+
+// A region of memory that hands out many small allocations by bumping a
+// pointer, then releases them all at once.
+//
+// Memory comes in chunks, each one at least as big as the last, so that an
+// arena that is reset and reused quickly settles into a single chunk.
+// Both the arena and its chunks come from a `Heap`, attributed to the site that
+// created the arena; the same heap must be passed to every call.
+typedef struct Arena Arena;
+typedef struct ArenaChunk ArenaChunk;
+
+struct ArenaChunk {
+  ArenaChunk* prev;
+  size_t cap_bytes;
+  _Alignas(max_align_t) byte data[];
+};
+
+struct Arena {
+  ArenaChunk* chunk; // the chunk currently being bumped through (NULL until first use)
+  byte* next;
+  byte* end;
+  uintptr_t site;
+};
+
+Arena* newArena(Heap* heap, size_t cap_bytes, uintptr_t site);
+void* arenaAlloc(Heap* heap, Arena* self, size_t size_bytes);
+void resetArena(Heap* heap, Arena* self);
+void destroyArena(Heap* heap, Arena* self);
+
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef BSVM_H
+#define BSVM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// The interface for embedding bsvm in a host program, as provided by libbsvm.
+// Nothing else under src/ is meant to be stable.
+//
+// A machine is reusable: once a program exits, `bsvmStart` can put the same
+// machine (with the same or another program) back at an entrypoint. This only
+// resets registers and reuses the existing frame, globals and return value
+// buffers, so hosts that serve many requests should keep a pool of machines
+// rather than creating one per request. Any heap blocks a program leaks are
+// released when its machine is restarted or freed.
+//
+// A machine must not be used from more than one thread at once, but different
+// machines may run concurrently, even sharing a program.
+
+// libbsvm.so is built with hidden visibility, so only what is marked here is
+// exported from it.
+#if defined(__GNUC__)
+#define BSVM_API __attribute__((visibility("default")))
+#else
+#define BSVM_API
+#endif
+
+typedef struct BsvmProgram BsvmProgram;
+typedef struct BsvmMachine BsvmMachine;
+
+typedef enum BsvmStatus BsvmStatus;
+enum BsvmStatus {
+  BSVM_EXITED,      // the program executed `EXIT` (or hit a fatal error, with exit
+                    // code -1); see `bsvmExitCode`
+  BSVM_OUT_OF_FUEL, // the program can be resumed with another `bsvmRun`
+  BSVM_IDLE,        // no program has been started
+};
+
+// Load a program from a bytecode file, or from the contents of one.
+// The buffer need not outlive the call.
+// Return NULL when the program is malformed (or on I/O error).
+BSVM_API BsvmProgram* bsvmLoadFile(const char* filename);
+BSVM_API BsvmProgram* bsvmLoadBuffer(const void* buf, size_t len);
+// Only free a program once no machine is running it.
+BSVM_API void bsvmFreeProgram(BsvmProgram* prog);
+
+// Return NULL when out of memory.
+BSVM_API BsvmMachine* bsvmNewMachine(void);
+BSVM_API void bsvmFreeMachine(BsvmMachine* machine);
+
+// Replace one of the streams a program can get from `STRM` (0 for input, 1 for
+// output, 2 for errors) with callbacks. Each callback transfers up to `len`
+// bytes and returns how many it did; zero means end-of-file for reads and an
+// error for writes. Either callback may be NULL if the stream is only used one
+// way. Output is buffered, but flushed whenever `bsvmRun` returns.
+// Returns 0 on success.
+typedef size_t (*BsvmReadFn)(void* ctx, char* buf, size_t len);
+typedef size_t (*BsvmWriteFn)(void* ctx, const char* buf, size_t len);
+BSVM_API int bsvmSetStream(BsvmMachine* machine, int id, void* ctx, BsvmReadFn read, BsvmWriteFn write);
+
+// Prepare a machine to run a program from its entrypoint, abandoning whatever
+// it was running before. The machine borrows the program and the arguments
+// until the next `bsvmStart` or `bsvmFreeMachine`.
+// Returns 0 on success.
+BSVM_API int bsvmStart(BsvmMachine* machine, BsvmProgram* prog, size_t argc, char** argv);
+
+// Continue executing until the program exits or has made `fuel` control
+// transfers (see `--fuel`); zero fuel means no limit.
+BSVM_API BsvmStatus bsvmRun(BsvmMachine* machine, uint64_t fuel);
+
+// Only meaningful once `bsvmRun` has returned `BSVM_EXITED`.
+BSVM_API int bsvmExitCode(const BsvmMachine* machine);
+
+
+#endif
@@ -0,0 +1,125 @@
+#define _XOPEN_SOURCE 700
+
+#include "common.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "serve.h"
+
+
+// A thin client for `bsvm --serve`: forward our arguments and standard streams
+// to the daemon, and exit with whatever the program exits with.
+
+
+static void usage(void) {
+  fprintf(stderr, "usage: bsvmc [--socket <path>] <bytecode file> <args to program...>\n"
+                  "the socket defaults to $" SERVE_SOCKET_ENV "\n");
+}
+
+static bool writeAll(int fd, const void* buf, size_t len) {
+  const byte* p = buf;
+  while (len != 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* socketPath = getenv(SERVE_SOCKET_ENV);
+  int argi = 1;
+  if (argi + 1 < argc && strcmp(argv[argi], "--socket") == 0) {
+    socketPath = argv[argi + 1];
+    argi += 2;
+  }
+  if (socketPath == NULL || argi >= argc) {
+    usage();
+    return 1;
+  }
+  // the daemon has its own working directory, so send absolute paths
+  char* cwd = getcwd(NULL, 0);
+  char* progPath = realpath(argv[argi], NULL);
+  if (cwd == NULL || progPath == NULL) {
+    fprintf(stderr, "[ERROR] cannot resolve %s\n", argv[argi]);
+    return 1;
+  }
+  size_t payload_bytes = strlen(cwd) + 1 + strlen(progPath) + 1;
+  for (int i = argi + 1; i < argc; ++i) { payload_bytes += strlen(argv[i]) + 1; }
+  if (payload_bytes > SERVE_MAX_PAYLOAD_BYTES || (size_t)(argc - argi) > SERVE_MAX_ARGC) {
+    fprintf(stderr, "[ERROR] too many or too long arguments for the server\n");
+    return 1;
+  }
+  char* payload = malloc(payload_bytes);
+  if (payload == NULL) { return 1; }
+  {
+    char* p = payload;
+    p = stpcpy(p, cwd) + 1;
+    p = stpcpy(p, progPath) + 1;
+    for (int i = argi + 1; i < argc; ++i) { p = stpcpy(p, argv[i]) + 1; }
+  }
+
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "[ERROR] socket path too long: %s\n", socketPath);
+    return 1;
+  }
+  strcpy(addr.sun_path, socketPath);
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "[ERROR] cannot connect to %s: %s\n", socketPath, strerror(errno));
+    return 1;
+  }
+
+  ServeRequest req = {
+    .magic = SERVE_MAGIC,
+    .argc = argc - argi,
+    .payload_bytes = payload_bytes,
+  };
+  int fds[3] = { 0, 1, 2 };
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buf,
+    .msg_controllen = sizeof(control.buf),
+  };
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  ssize_t sent;
+  do { sent = sendmsg(sock, &msg, 0); } while (sent < 0 && errno == EINTR);
+  if (sent <= 0
+      || !writeAll(sock, (byte*)&req + sent, sizeof(req) - sent)
+      || !writeAll(sock, payload, payload_bytes)) {
+    fprintf(stderr, "[ERROR] cannot send request: %s\n", strerror(errno));
+    return 1;
+  }
+
+  int32_t exitcode;
+  byte* p = (byte*)&exitcode;
+  size_t left = sizeof(exitcode);
+  while (left != 0) {
+    ssize_t n = read(sock, p, left);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) {
+      fprintf(stderr, "[ERROR] lost connection to %s\n", socketPath);
+      return 1;
+    }
+    p += n;
+    left -= n;
+  }
+  return exitcode;
+}
@@ -59,12 +59,14 @@ _Static_assert(sizeof(word) == sizeof(uintptr_t), "the compiler inserted padding
 // across integral types, or that overflow is handled by wrapping. Luckily, I
 // don't think I have to support the PDP-1.
 
+// Integers two words wide, for the full results of multiplying words.
+// (Not `ulong`/`slong`, which glibc defines itself under `_GNU_SOURCE`.)
 #if __SIZEOF_POINTER__ == 4
-typedef uint64_t ulong;
-typedef int64_t slong;
+typedef uint64_t dword;
+typedef int64_t sdword;
 #else
-typedef __uint128_t ulong;
-typedef __int128_t slong;
+typedef __uint128_t dword;
+typedef __int128_t sdword;
 #endif
 
 
@@ -0,0 +1,135 @@
+#include "debug.h"
+
+#include "execute.h"
+
+
+int initDebugger(Debugger* out, size_t traceCap) {
+  out->trace.cap = traceCap;
+  out->trace.count = 0;
+  out->trace.ring = NULL;
+  out->trace.depth = 0;
+  if (traceCap != 0) {
+    out->trace.ring = malloc(sizeof(TraceRecord) * traceCap);
+    if (out->trace.ring == NULL) { return -1; }
+  }
+  out->step.onStep = NULL;
+  out->step.ctx = NULL;
+  out->step.single = false;
+  out->step.breakpoints = NULL;
+  out->step.breakpoint_count = 0;
+  out->watch.onWatch = NULL;
+  out->watch.ctx = NULL;
+  out->watch.addr = NULL;
+  return 0;
+}
+
+void destroyDebugger(Debugger* self) {
+  free(self->trace.ring);
+  self->trace.ring = NULL;
+  self->trace.cap = 0;
+}
+
+void attachDebugger(Machine* machine, Debugger* self) {
+  uint32_t depth = 0;
+  for (StackFrame* frame = machine->top; frame->prev != NULL; frame = frame->prev) { ++depth; }
+  self->trace.depth = depth;
+  machine->debug = self;
+}
+
+void watchWord(Debugger* self, const word* addr, WatchHook onWatch, void* ctx) {
+  self->watch.addr = addr;
+  self->watch.last = *addr;
+  self->watch.onWatch = onWatch;
+  self->watch.ctx = ctx;
+}
+
+
+////// Handlers //////
+
+// Each handler is entered just as `cycle` would enter a normal one: with `ip`
+// already past the opcode.
+
+static void traceOne(Machine* self) {
+  Debugger* dbg = self->debug;
+  byte* here = self->ip - 1;
+  byte opcode = *here;
+  if (dbg->trace.cap != 0) {
+    TraceRecord* rec = &dbg->trace.ring[dbg->trace.count % dbg->trace.cap];
+    rec->ip = here - self->program->code;
+    rec->depth = dbg->trace.depth;
+    rec->opcode = opcode;
+  }
+  dbg->trace.count += 1;
+  normalDispatch[opcode](self);
+  // tail calls (`JAR`) replace the frame, so leave depth alone
+  switch (opcode) {
+    case 0x80: case 0x81: dbg->trace.depth += 1; break;
+    case 0x84: dbg->trace.depth -= 1; break;
+    default: break;
+  }
+}
+
+static bool isBreakpoint(const Debugger* self, size_t at) {
+  for (size_t i = 0; i < self->step.breakpoint_count; ++i) {
+    if (self->step.breakpoints[i] == at) { return true; }
+  }
+  return false;
+}
+
+static void stepOne(Machine* self) {
+  Debugger* dbg = self->debug;
+  byte* here = self->ip - 1;
+  if (dbg->step.onStep != NULL
+      && (dbg->step.single || isBreakpoint(dbg, here - self->program->code))) {
+    self->ip = here;
+    dbg->step.onStep(self, dbg->step.ctx);
+    if (self->shouldHalt) { return; }
+    self->ip = here + 1;
+  }
+  normalDispatch[*here](self);
+}
+
+static void watchOne(Machine* self) {
+  Debugger* dbg = self->debug;
+  normalDispatch[*(self->ip - 1)](self);
+  if (dbg->watch.addr != NULL && dbg->watch.addr->bits != dbg->watch.last.bits) {
+    word old = dbg->watch.last;
+    dbg->watch.last = *dbg->watch.addr;
+    if (dbg->watch.onWatch != NULL) { dbg->watch.onWatch(self, dbg->watch.ctx, old); }
+  }
+}
+
+// (a GNU extension, but this relies on gcc already; see common.h)
+const OpHandler tracingDispatch[256] = { [0x00 ... 0xFF] = traceOne };
+const OpHandler steppingDispatch[256] = { [0x00 ... 0xFF] = stepOne };
+const OpHandler watchingDispatch[256] = { [0x00 ... 0xFF] = watchOne };
+
+
+////// Trace Files //////
+
+// A trace file is the magic number "BsvmTrc1", the total number of records
+// made (u64), and the number kept (u64), followed by the kept records oldest
+// first, each an ip (u32), depth (u32), opcode (u8) and three bytes of padding.
+// All numbers are little-endian.
+
+static bool putLE(FILE* fp, uint64_t n, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    if (putc((n >> (8 * i)) & 0xFF, fp) == EOF) { return false; }
+  }
+  return true;
+}
+
+int writeTrace(const Debugger* self, FILE* fp) {
+  uint64_t kept = self->trace.count < self->trace.cap ? self->trace.count : self->trace.cap;
+  bool ok = fwrite("BsvmTrc1", 1, 8, fp) == 8
+         && putLE(fp, self->trace.count, 8)
+         && putLE(fp, kept, 8);
+  for (uint64_t i = self->trace.count - kept; ok && i < self->trace.count; ++i) {
+    const TraceRecord* rec = &self->trace.ring[i % self->trace.cap];
+    ok = putLE(fp, rec->ip, 4)
+      && putLE(fp, rec->depth, 4)
+      && putLE(fp, rec->opcode, 1)
+      && putLE(fp, 0, 3);
+  }
+  return ok ? 0 : -1;
+}
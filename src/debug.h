@@ -0,0 +1,73 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "types.h"
+
+
+// Instrumented dispatch tables, for tracing and debugging.
+//
+// Each of these tables wraps every handler of the normal one. To instrument a
+// machine, attach a `Debugger` to it and point its `dispatch` at one of them;
+// to stop, point it back at `normalDispatch`. Switching is a single pointer
+// store, so it can happen between any two instructions, even from a signal
+// handler, as long as the debugger was attached beforehand. A machine using the
+// normal table pays nothing for any of this.
+//
+// The tables are:
+//   * `tracingDispatch`: records each instruction in the debugger's ring buffer
+//   * `steppingDispatch`: calls `onStep` before each instruction (when
+//     single-stepping) or before those at breakpoints
+//   * `watchingDispatch`: calls `onWatch` after any instruction that changes
+//     the watched word
+
+typedef struct TraceRecord TraceRecord;
+struct TraceRecord {
+  uint32_t ip; // offset into the code
+  uint32_t depth; // frames below the executing one
+  uint8_t opcode;
+};
+
+// Called with `ip` at the instruction about to execute. Setting `shouldHalt`
+// pauses the machine without executing it.
+typedef void (*StepHook)(Machine* machine, void* ctx);
+// Called after the instruction that changed the watched word.
+typedef void (*WatchHook)(Machine* machine, void* ctx, word old);
+
+struct Debugger {
+  struct {
+    size_t cap;
+    uint64_t count; // every record ever made; only the last `cap` are kept
+    TraceRecord* ring;
+    uint32_t depth;
+  } trace;
+  struct {
+    StepHook onStep;
+    void* ctx;
+    bool single; // stop at every instruction, not just breakpoints
+    const size_t* breakpoints; // code offsets
+    size_t breakpoint_count;
+  } step;
+  struct {
+    WatchHook onWatch;
+    void* ctx;
+    const word* addr;
+    word last;
+  } watch;
+};
+
+extern const OpHandler tracingDispatch[256];
+extern const OpHandler steppingDispatch[256];
+extern const OpHandler watchingDispatch[256];
+
+// The trace ring buffer holds `traceCap` records (none if zero).
+// Everything else starts disabled; fill in the fields to enable it.
+int initDebugger(Debugger* out, size_t traceCap);
+void destroyDebugger(Debugger* self);
+void attachDebugger(Machine* machine, Debugger* self);
+void watchWord(Debugger* self, const word* addr, WatchHook onWatch, void* ctx);
+
+// Write the trace oldest-first in the format read by scripts/decode-trace.py.
+int writeTrace(const Debugger* self, FILE* fp);
+
+
+#endif
@@ -1,148 +1,217 @@
 #include "execute.h"
 
+#include "arena.h"
+#include "gc.h"
+#include "shm.h"
+#include "snapshot.h"
+
 #include "execute/opcodes.c"
 
+// Opcodes that have no instruction land here.
+static void badOpcode(Machine* self) {
+  fprintf(stderr, "unexpected opcode %x\n", *(self->ip - 1));
+  self->exitcode = -1;
+  self->shouldHalt = true;
+}
+
+// The default dispatch table, with no instrumentation whatsoever.
+const OpHandler normalDispatch[256] = {
+  // (a GNU extension, but this relies on gcc already; see common.h)
+  [0x00 ... 0xFF] = badOpcode,
+  // 0x00: halt and catch fire in case ip goes out-of-bounds
+  [0x00] = halt,
+  // 0x01 - 0x0F: loads, stores, moves, and address calculation
+  // [0x01] = ???,
+  [0x02] = move,
+  [0x03] = moveImm,
+  [0x04] = load,
+  [0x05] = loadOff,
+  [0x06] = store,
+  [0x07] = storeOff,
+  [0x08] = ldGlobal,
+  [0x09] = stGlobal,
+  [0x0A] = lea,
+  [0x0B] = lia,
+  [0x0C] = loadByte,
+  [0x0D] = loadByteOff,
+  [0x0E] = storeByte,
+  [0x0F] = storeByteOff,
+
+  // 0x10 - 0x1F: arithmetic
+  [0x10] = add,
+  [0x11] = addImm,
+  [0x12] = sub,
+  [0x13] = subImm,
+  [0x14] = adc,
+  [0x15] = divWide,
+  [0x16] = sbb,
+  [0x17] = neg,
+  [0x18] = mul,
+  [0x19] = muc,
+  [0x1A] = imul,
+  [0x1B] = imuc,
+  [0x1C] = divide,
+  [0x1D] = divrem,
+  [0x1E] = idivide,
+  [0x1F] = idivrem,
+
+  // 0x20-0x3F: bit fiddling
+  [0x20] = popCount,
+  [0x21] = countLeadingZeros,
+  [0x22] = countTrailingZeros,
+  [0x23] = byteSwap,
+  [0x24] = bitExtract,
+  [0x25] = bitDeposit,
+  [0x26] = bitSelect,
+  [0x27] = fieldExtract,
+  [0x28] = fieldInsert,
+  [0x30] = bitOr,
+  [0x31] = bitOrImm,
+  [0x32] = xor,
+  [0x33] = xorImm,
+  [0x34] = bitAnd,
+  [0x35] = bitAndImm,
+  // [0x36] = ???,
+  [0x37] = inv,
+  [0x38] = szr,
+  [0x39] = szrImm,
+  [0x3A] = sar,
+  [0x3B] = sarImm,
+  [0x3C] = shl,
+  [0x3D] = shlImm,
+  [0x3E] = rol,
+  [0x3F] = rolImm,
+
+  // 0x40 - 0x4F: memory operations
+  [0x40] = vmAlloc,
+  [0x41] = vmFree,
+  [0x42] = vmRealloc,
+  [0x43] = newRegion,
+  [0x44] = offset,
+  [0x45] = offsetImm,
+  [0x46] = regionAlloc,
+  [0x47] = regionFree,
+  [0x48] = memMove,
+  // TODO [0x49] = memSet,
+  // TODO [0x4A] mbrk r<dst>, r<src>, r<len>, r<chrs>, r<numChrs> // like C strpbrk
+  // TODO [0x4B] mspn r<dst>, r<src>, r<len>, r<chrs>, r<numChrs> // like C strcspn
+  // TODO [0x4C] = memImplode,
+  // TODO [0x4D] = memExplode,
+  [0x4E] = memEqual,
+  [0x4F] = memNotEqual,
+
+  // 0x50-0x5F tests
+  [0x50] = bitTest,
+  [0x51] = not,
+  [0x52] = any,
+  [0x53] = all,
+  [0x54] = setEq,
+  [0x55] = setEqImm,
+  [0x56] = setNeq,
+  [0x57] = setNeqImm,
+  [0x58] = setBelow,
+  [0x59] = setBelowImm,
+  [0x5A] = setBelowEq,
+  [0x5B] = setBelowEqImm,
+  [0x5C] = setLt,
+  [0x5D] = setLtImm,
+  [0x5E] = setLte,
+  [0x5F] = setLteImm,
+
+  // 0x60 - 0x6F: conditioned operations
+  [0x60] = cmov,
+  [0x61] = cmovi,
+  [0x62] = zmov,
+  [0x63] = zmovi,
+  [0x64] = cld,
+  [0x65] = cldOff,
+  [0x66] = zld,
+  [0x67] = zldOff,
+  [0x68] = cst,
+  [0x69] = cstOff,
+  [0x6A] = zst,
+  [0x6B] = zstOff,
+  // 0x70 - 0x7F: jumps
+  [0x70] = computedJump,
+  [0x71] = jump,
+  [0x72] = cjump,
+  [0x73] = zjump,
+
+
+  [0x80] = jalr,
+  [0x81] = jal,
+  [0x82] = jarr,
+  [0x83] = jar,
+  [0x84] = ret,
+  [0x85] = into,
+  [0x86] = exit_,
+  [0x87] = snap,
+
+  // 0x90 - 0x9F: sized memory access, multi-word arithmetic, hashing, numbers, and sorting
+  [0x90] = loadSizedReg,
+  [0x91] = loadSizedOff,
+  [0x92] = storeSizedReg,
+  [0x93] = storeSizedOff,
+  [0x94] = adcN,
+  [0x95] = sbbN,
+  [0x96] = macN,
+  [0x97] = divN,
+  [0x98] = hash,
+  [0x99] = formatNumber,
+  [0x9A] = parseNumber,
+  [0x9B] = sortRecords,
+  [0x9C] = searchRecords,
+  [0x9D] = mergeRecords,
+
+  // 0xA0 - 0xAF: vectors
+  [0xA0] = vecLoad,
+  [0xA1] = vecStore,
+  [0xA2] = vecSplat,
+  [0xA3] = vecEq,
+  [0xA4] = vecBelow,
+  [0xA5] = vecAdd,
+  [0xA6] = vecSub,
+  [0xA7] = vecAnd,
+  [0xA8] = vecOr,
+  [0xA9] = vecXor,
+  [0xAA] = vecShuffle,
+  [0xAB] = vecMoveMask,
+  [0xAC] = vecSum,
+  // string operations? like what? codec-y stuff?
+
+  // ... 0xC0-0xFF i/o
+  // 0xC0 - 0xCF environment access
+  [0xC0] = strm,
+  // TODO [0xC1] = getEnv,
+  [0xC2] = getArgc,
+  [0xC3] = getArgv,
+
+  // 0xD0 - 0xDF file manipulation
+  [0xD0] = openFile,
+  [0xD1] = closeFile,
+  [0xD2] = getBytes,
+  [0xD3] = putBytes,
+  [0xD4] = getByte,
+  [0xD5] = putByte,
+  // 0xD6 ???
+  [0xD7] = flushFile,
+  [0xD8] = tellFile,
+  [0xD9] = seekFile,
+  [0xDA] = asyncGet,
+  [0xDB] = asyncPut,
+  [0xDC] = asyncWait,
+  [0xDD] = asyncPoll,
+
+  // 0xE0 - 0xEF shared memory
+  [0xE0] = shmMap,
+  [0xE1] = shmUnmap,
+  [0xE2] = shmRemove,
+  [0xE3] = futexSleep,
+  [0xE4] = futexWakeUp,
+  [0xE5] = loadAtomic,
+  [0xE6] = storeAtomic,
+};
+
 void cycle(Machine* self) {
-  switch (*self->ip++) {
-    // 0x00: halt and catch fire in case ip goes out-of-bounds
-    case 0x00: halt(self); break;
-    // 0x01 - 0x0F: loads, stores, moves, and address calculation
-    // case 0x01: ???(self); break;
-    case 0x02: move(self); break;
-    case 0x03: moveImm(self); break;
-    case 0x04: load(self); break;
-    case 0x05: loadOff(self); break;
-    case 0x06: store(self); break;
-    case 0x07: storeOff(self); break;
-    case 0x08: ldGlobal(self); break;
-    case 0x09: stGlobal(self); break;
-    case 0x0A: lea(self); break;
-    case 0x0B: lia(self); break;
-    case 0x0C: loadByte(self); break;
-    // case 0x0D // load byte with immediate offset?
-    case 0x0E: storeByte(self); break;
-    // case 0x0F // store byte with immediate offset?
-
-    // 0x10 - 0x1F: arithmetic
-    case 0x10: add(self); break;
-    case 0x11: addImm(self); break;
-    case 0x12: sub(self); break;
-    case 0x13: subImm(self); break;
-    case 0x14: adc(self); break;
-    // case 0x15: ???(self); break;
-    case 0x16: sbb(self); break;
-    case 0x17: neg(self); break;
-    case 0x18: mul(self); break;
-    case 0x19: muc(self); break;
-    case 0x1A: imul(self); break;
-    case 0x1B: imuc(self); break;
-    case 0x1C: divide(self); break;
-    case 0x1D: divrem(self); break;
-    case 0x1E: idivide(self); break;
-    case 0x1F: idivrem(self); break;
-
-    // 0x20-0x3F: bit fiddling
-    case 0x30: bitOr(self); break;
-    case 0x31: bitOrImm(self); break;
-    case 0x32: xor(self); break;
-    case 0x33: xorImm(self); break;
-    case 0x34: bitAnd(self); break;
-    case 0x35: bitAndImm(self); break;
-    // case 0x36: ???(self); break;
-    case 0x37: inv(self); break;
-    case 0x38: szr(self); break;
-    case 0x39: szrImm(self); break;
-    case 0x3A: sar(self); break;
-    case 0x3B: sarImm(self); break;
-    case 0x3C: shl(self); break;
-    case 0x3D: shlImm(self); break;
-    case 0x3E: rol(self); break;
-    case 0x3F: rolImm(self); break;
-
-    // 0x40 - 0x4F: memory operations
-    case 0x40: vmAlloc(self); break;
-    case 0x41: vmFree(self); break;
-    case 0x42: vmRealloc(self); break;
-    // case 0x43: ???(self); break;
-    case 0x44: offset(self); break;
-    case 0x45: offsetImm(self); break;
-    // case 0x46: ???(self); break;
-    // case 0x47: ???(self); break;
-    case 0x48: memMove(self); break;
-    // TODO case 0x49: memSet(self); break;
-    // TODO case 0x4A: mbrk r<dst>, r<src>, r<len>, r<chrs>, r<numChrs> // like C strpbrk
-    // TODO case 0x4B: mspn r<dst>, r<src>, r<len>, r<chrs>, r<numChrs> // like C strcspn
-    // TODO case 0x4C: memImplode(self); break;
-    // TODO case 0x4D: memExplode(self); break;
-    case 0x4E: memEqual(self); break;
-    case 0x4F: memNotEqual(self); break;
-
-    // 0x50-0x5F tests
-    case 0x50: bitTest(self); break;
-    case 0x51: not(self); break;
-    case 0x52: any(self); break;
-    case 0x53: all(self); break;
-    case 0x54: setEq(self); break;
-    case 0x55: setEqImm(self); break;
-    case 0x56: setNeq(self); break;
-    case 0x57: setNeqImm(self); break;
-    case 0x58: setBelow(self); break;
-    case 0x59: setBelowImm(self); break;
-    case 0x5A: setBelowEq(self); break;
-    case 0x5B: setBelowEqImm(self); break;
-    case 0x5C: setLt(self); break;
-    case 0x5D: setLtImm(self); break;
-    case 0x5E: setLte(self); break;
-    case 0x5F: setLteImm(self); break;
-
-    // 0x60 - 0x6F: conditioned operations
-    case 0x60: cmov(self); break;
-    case 0x61: cmovi(self); break;
-    case 0x62: zmov(self); break;
-    case 0x63: zmovi(self); break;
-    // TODO cld
-    // TODO zld
-    // TODO cst
-    // TODO zst
-    // 0x70 - 0x7F: jumps
-    case 0x70: computedJump(self); break;
-    case 0x71: jump(self); break;
-    case 0x72: cjump(self); break;
-    case 0x73: zjump(self); break;
-
-
-    case 0x80: jalr(self); break;
-    case 0x81: jal(self); break;
-    case 0x82: jarr(self); break;
-    case 0x83: jar(self); break;
-    case 0x84: ret(self); break;
-    case 0x85: into(self); break;
-    case 0x86: exit_(self); break;
-    // 0x87
-    // string operations? like what? codec-y stuff?
-
-    // ... 0xC0-0xFF i/o
-    // 0xC0 - 0xCF environment access
-    case 0xC0: strm(self); break;
-    // TODO case 0xC1: getEnv(self); break;
-    case 0xC2: getArgc(self); break;
-    case 0xC3: getArgv(self); break;
-
-    // 0xD0 - 0xDF file manipulation
-    case 0xD0: openFile(self); break;
-    case 0xD1: closeFile(self); break;
-    case 0xD2: getBytes(self); break;
-    case 0xD3: putBytes(self); break;
-    case 0xD4: getByte(self); break;
-    case 0xD5: putByte(self); break;
-    // 0xD6 ???
-    case 0xD7: flushFile(self); break;
-    case 0xD8: tellFile(self); break;
-    case 0xD9: seekFile(self); break;
-
-    default: {
-      fprintf(stderr, "unexpected opcode %x\n", *(self->ip - 1));
-      exit(-1);
-    } break;
-  }
+  self->dispatch[*self->ip++](self);
 }
@@ -4,8 +4,12 @@
 #include "types.h"
 
 
+// Execute the instruction at `ip` through the machine's current dispatch table.
 void cycle(Machine* machine);
 
+// The table machines start with. It carries no instrumentation at all; see
+// debug.h for the alternatives.
+extern const OpHandler normalDispatch[256];
 
 
 #endif
@@ -79,27 +79,41 @@ void storeOff(Machine* self) {
   self->top->r[dst].wptr[imm] = self->top->r[src];
 }
 
+// Globals spring into existence (zeroed) the first time they are mentioned.
+// Halts the machine (like `halt`) and returns false when out of memory.
+static inline
+bool growGlobals(Machine* self, size_t ix) {
+  if (ix < self->global.len) { return true; }
+  word* at = realloc(self->global.at, sizeof(word) * (ix + 1));
+  if (at == NULL) {
+    fprintf(stderr, "[ERROR] out of memory for global %zu\n", ix);
+    self->exitcode = -1;
+    self->shouldHalt = true;
+    return false;
+  }
+  memset(at + self->global.len, 0, sizeof(word) * (ix + 1 - self->global.len));
+  self->global.at = at;
+  self->global.len = ix + 1;
+  return true;
+}
+
 // 0x08 LDG r<dst>, imm<ix>
 // Load global value.
 static inline
 void ldGlobal(Machine* self) {
   size_t dst = readVarint(&self->ip);
   size_t ix = readVarint(&self->ip);
-  if (ix >= self->global.len) {
-    self->global.at = realloc(self->global.at, sizeof(word*) * ix);
-  }
+  if (!growGlobals(self, ix)) { return; }
   self->top->r[dst].bits = self->global.at[ix].bits;
 }
 
-// 0x09 STG imm<ix>, reg<src>
+// 0x09 STG imm<ix>, r<src>
 // Store global value.
 static inline
 void stGlobal(Machine* self) {
   size_t ix = readVarint(&self->ip);
   size_t src = readVarint(&self->ip);
-  if (ix >= self->global.len) {
-    self->global.at = realloc(self->global.at, sizeof(word*) * ix);
-  }
+  if (!growGlobals(self, ix)) { return; }
   self->global.at[ix].bits = self->top->r[src].bits;
 }
 
@@ -134,6 +148,16 @@ void loadByte(Machine* self) {
   self->top->r[dst].bits = *self->top->r[src].bptr;
 }
 
+// 0x0D LDB r<dst>, r<src>, imm<off>
+// Load a byte from the address in src + off and place it in dst.
+static inline
+void loadByteOff(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  ptrdiff_t off = readVarint(&self->ip);
+  self->top->r[dst].bits = self->top->r[src].bptr[off];
+}
+
 // 0x0E STB r<dst>, r<src>
 // Store contents of the src register into memory pointed to by dst register.
 static inline
@@ -143,6 +167,16 @@ void storeByte(Machine* self) {
   *self->top->r[dst].bptr = self->top->r[src].byte.low;
 }
 
+// 0x0F STB r<dst>, imm<off>, r<src>
+// Store the low byte of src into memory at the address dst + off.
+static inline
+void storeByteOff(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  ptrdiff_t off = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  self->top->r[dst].bptr[off] = self->top->r[src].byte.low;
+}
+
 // 0x10 ADD r<dst>, r<src>
 static inline
 void add(Machine* self) {
@@ -188,6 +222,23 @@ void adc(Machine* self) {
   self->top->r[carry].bits = val < val0 ? 1 : 0;
 }
 
+// 0x15 DVW r<dst-high>, r<dst-low>, r<src>
+// unsigned double-by-single divide with remainder
+// dstLow <- dstHigh:dstLow / src ; dstHigh <- dstHigh:dstLow % src
+// The quotient only fits in a word when dstHigh < src; otherwise, only its low
+// word is kept.
+static inline
+void divWide(Machine* self) {
+  size_t dstHigh = readVarint(&self->ip);
+  size_t dstLow = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  dword numer = ((dword)self->top->r[dstHigh].bits << (CHAR_BIT * sizeof(uintptr_t)))
+              | self->top->r[dstLow].bits;
+  uintptr_t denom = self->top->r[src].bits;
+  self->top->r[dstLow].bits = (uintptr_t)(numer / denom);
+  self->top->r[dstHigh].bits = (uintptr_t)(numer % denom);
+}
+
 // 0x16 SBB r<borrow>, r<dst>, r<src>
 static inline
 void sbb(Machine* self) {
@@ -228,11 +279,11 @@ void muc(Machine* self) {
   size_t dstHigh = readVarint(&self->ip);
   size_t dstLow = readVarint(&self->ip);
   size_t src = readVarint(&self->ip);
-  ulong a = self->top->r[dstLow].bits;
-  ulong b = self->top->r[src].bits;
-  ulong r = a * b;
+  dword a = self->top->r[dstLow].bits;
+  dword b = self->top->r[src].bits;
+  dword r = a * b;
   self->top->r[dstLow].bits = (uintptr_t)r;
-  self->top->r[dstHigh].bits = (uintptr_t)(r >> sizeof(uintptr_t));
+  self->top->r[dstHigh].bits = (uintptr_t)(r >> (CHAR_BIT * sizeof(uintptr_t)));
 }
 
 // 0x1A IMUL r<dst>, r<src>
@@ -246,19 +297,19 @@ void imul(Machine* self) {
 
 // 0x1B IMUC r<dst-high>, r<dst-low>, r<src>
 // signed double-width multiply
+// dstHigh:dstLow <- dstLow * src
+// The product is in two's complement across both words, so the sign is in the
+// top bit of dstHigh, and dstLow holds the low bits as-is.
 static inline
 void imuc(Machine* self) {
-  // size_t dstHigh = readVarint(&self->ip);
-  // size_t dstLow = readVarint(&self->ip);
-  // size_t src = readVarint(&self->ip);
-  // slong a = self->top->r[dstLow].sbits;
-  // slong b = self->top->r[src].sbits;
-  // slong r = a * b;
-  fprintf(stderr, "oh jeez, I don't actually know what's normal for a signed double-width multiply\n");
-  exit(-1);
-  // I guess the low size-1 bits should go in low, plus the sign bit, and the high size-1 bits in high plus its own sign bit?
-  // self->top->r[dstLow].bits = (uintptr_t)r;
-  // self->top->r[dstHigh].bits = (uintptr_t)(r >> sizeof(uintptr_t));
+  size_t dstHigh = readVarint(&self->ip);
+  size_t dstLow = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  sdword a = self->top->r[dstLow].sbits;
+  sdword b = self->top->r[src].sbits;
+  dword r = (dword)(a * b);
+  self->top->r[dstLow].bits = (uintptr_t)r;
+  self->top->r[dstHigh].bits = (uintptr_t)(r >> (CHAR_BIT * sizeof(uintptr_t)));
 }
 
 // 0x1C DIV r<dst>, r<src>
@@ -327,6 +378,156 @@ void idivrem(Machine* self) {
  Bit Fiddling
  ************************************/
 
+// These use compiler builtins, which become single instructions (`POPCNT`,
+// `LZCNT`, `TZCNT`, `BSWAP`, and with BMI2, `PEXT`/`PDEP`) when the target
+// has them, e.g. when built with `-march=native`.
+
+#define WORD_BITS (CHAR_BIT * sizeof(word))
+static uintptr_t shiftMask = WORD_BITS - 1;
+#if __SIZEOF_POINTER__ == __SIZEOF_LONG__
+  #define POPCOUNT_WORD __builtin_popcountl
+  #define CLZ_WORD __builtin_clzl
+  #define CTZ_WORD __builtin_ctzl
+#else
+  #define POPCOUNT_WORD __builtin_popcountll
+  #define CLZ_WORD __builtin_clzll
+  #define CTZ_WORD __builtin_ctzll
+#endif
+#if __SIZEOF_POINTER__ == 4
+  #define BSWAP_WORD __builtin_bswap32
+#else
+  #define BSWAP_WORD __builtin_bswap64
+#endif
+
+// 0x20 POPC r<dst>, r<src>
+// Count the set bits in src.
+static inline
+void popCount(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  self->top->r[dst].bits = POPCOUNT_WORD(self->top->r[src].bits);
+}
+
+// 0x21 CLZ r<dst>, r<src>
+// Count the leading (most-significant) zero bits in src.
+// A zero src has as many leading zeros as there are bits in a word.
+static inline
+void countLeadingZeros(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  uintptr_t x = self->top->r[src].bits;
+  self->top->r[dst].bits = x == 0 ? WORD_BITS : (uintptr_t)CLZ_WORD(x);
+}
+
+// 0x22 CTZ r<dst>, r<src>
+// Count the trailing (least-significant) zero bits in src.
+// A zero src has as many trailing zeros as there are bits in a word.
+static inline
+void countTrailingZeros(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  uintptr_t x = self->top->r[src].bits;
+  self->top->r[dst].bits = x == 0 ? WORD_BITS : (uintptr_t)CTZ_WORD(x);
+}
+
+// 0x23 BSWP r<dst>, r<src>
+// Reverse the order of the bytes in src.
+static inline
+void byteSwap(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  self->top->r[dst].bits = BSWAP_WORD(self->top->r[src].bits);
+}
+
+// 0x24 PEXT r<dst>, r<src>, r<mask>
+// "Parallel bit extract": gather the bits of src where mask is set into the
+// low bits of dst, in order.
+static inline
+void bitExtract(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t maskReg = readVarint(&self->ip);
+  uintptr_t x = self->top->r[src].bits;
+  uintptr_t mask = self->top->r[maskReg].bits;
+#if defined(__BMI2__) && __SIZEOF_POINTER__ == 8
+  self->top->r[dst].bits = __builtin_ia32_pext_di(x, mask);
+#else
+  uintptr_t out = 0;
+  for (uintptr_t bit = 1; mask != 0; bit <<= 1) {
+    uintptr_t lowest = mask & -mask;
+    if (x & lowest) { out |= bit; }
+    mask ^= lowest;
+  }
+  self->top->r[dst].bits = out;
+#endif
+}
+
+// 0x25 PDEP r<dst>, r<src>, r<mask>
+// "Parallel bit deposit": scatter the low bits of src, in order, to where mask
+// is set in dst. Bits of dst outside the mask are cleared.
+static inline
+void bitDeposit(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t maskReg = readVarint(&self->ip);
+  uintptr_t x = self->top->r[src].bits;
+  uintptr_t mask = self->top->r[maskReg].bits;
+#if defined(__BMI2__) && __SIZEOF_POINTER__ == 8
+  self->top->r[dst].bits = __builtin_ia32_pdep_di(x, mask);
+#else
+  uintptr_t out = 0;
+  for (uintptr_t bit = 1; mask != 0; bit <<= 1) {
+    uintptr_t lowest = mask & -mask;
+    if (x & bit) { out |= lowest; }
+    mask ^= lowest;
+  }
+  self->top->r[dst].bits = out;
+#endif
+}
+
+// 0x26 SEL r<dst>, r<mask>, r<src1>, r<src2>
+// Bitwise select: take bits from src1 where mask is set, and from src2 elsewhere.
+static inline
+void bitSelect(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t mask = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+  uintptr_t m = self->top->r[mask].bits;
+  self->top->r[dst].bits = (self->top->r[src1].bits & m) | (self->top->r[src2].bits & ~m);
+}
+
+// Ones in the low `width` bits (all of them if width is a word or more).
+static inline
+uintptr_t lowMask(uintptr_t width) {
+  return width >= WORD_BITS ? ~(uintptr_t)0 : ((uintptr_t)1 << width) - 1;
+}
+
+// 0x27 BFX r<dst>, r<src>, imm<lsb>, imm<width>
+// Bit-field extract: dst <- (src >> lsb) & (2^width - 1)
+static inline
+void fieldExtract(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  uintptr_t lsb = readVarint(&self->ip) & shiftMask;
+  uintptr_t width = readVarint(&self->ip);
+  self->top->r[dst].bits = (self->top->r[src].bits >> lsb) & lowMask(width);
+}
+
+// 0x28 BFI r<dst>, r<src>, imm<lsb>, imm<width>
+// Bit-field insert: replace the width bits of dst starting at lsb with the low
+// width bits of src. The other bits of dst are unchanged.
+static inline
+void fieldInsert(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  uintptr_t lsb = readVarint(&self->ip) & shiftMask;
+  uintptr_t width = readVarint(&self->ip);
+  uintptr_t mask = lowMask(width) << lsb;
+  self->top->r[dst].bits = (self->top->r[dst].bits & ~mask)
+                         | ((self->top->r[src].bits << lsb) & mask);
+}
+
 // 0x30 OR r<dst>, r<src>
 static inline
 void bitOr(Machine* self) {
@@ -384,9 +585,8 @@ void inv(Machine* self) {
   self->top->r[dst].bits = ~self->top->r[src].bits;
 }
 
-static uintptr_t shiftMask = CHAR_BIT * sizeof(word) - 1;
 
-// 0x38 SZR r<dst> r<src> r<amt>
+// 0x38 SZR r<dst>, r<src>, r<amt>
 // Shift right, zero-extending.
 static inline
 void szr(Machine* self) {
@@ -396,7 +596,7 @@ void szr(Machine* self) {
   self->top->r[dst].bits = self->top->r[src].bits >> (self->top->r[amt].bits & shiftMask);
 }
 
-// 0x39 SZR r<dst> r<src> imm<amt>
+// 0x39 SZR r<dst>, r<src>, imm<amt>
 // Shift right immediate, zero-extending.
 static inline
 void szrImm(Machine* self) {
@@ -406,7 +606,7 @@ void szrImm(Machine* self) {
   self->top->r[dst].bits = self->top->r[src].bits >> (amt & shiftMask);
 }
 
-// 0x3A SAR r<dst> r<src> r<amt>
+// 0x3A SAR r<dst>, r<src>, r<amt>
 // Shift right, sign-extending (i.e. arithmetic).
 static inline
 void sar(Machine* self) {
@@ -416,7 +616,7 @@ void sar(Machine* self) {
   self->top->r[dst].sbits = self->top->r[src].sbits >> (self->top->r[amt].bits & shiftMask);
 }
 
-// 0x3B SAR r<dst> r<src> imm<amt>
+// 0x3B SAR r<dst>, r<src>, imm<amt>
 // Shift right immediate, sign-extending (i.e. arithmetic).
 static inline
 void sarImm(Machine* self) {
@@ -426,7 +626,7 @@ void sarImm(Machine* self) {
   self->top->r[dst].sbits = self->top->r[src].sbits >> (amt & shiftMask);
 }
 
-// 0x3C SHL r<dst> r<src> r<amt>
+// 0x3C SHL r<dst>, r<src>, r<amt>
 // Shift left.
 static inline
 void shl(Machine* self) {
@@ -436,7 +636,7 @@ void shl(Machine* self) {
   self->top->r[dst].bits = self->top->r[src].bits << (self->top->r[amt].bits & shiftMask);
 }
 
-// 0x3D SHL r<dst> r<src> imm<amt>
+// 0x3D SHL r<dst>, r<src>, imm<amt>
 // Shift right immediate.
 static inline
 void shlImm(Machine* self) {
@@ -446,7 +646,7 @@ void shlImm(Machine* self) {
   self->top->r[dst].bits = self->top->r[src].bits << (amt & shiftMask);
 }
 
-// 0x3E ROL r<dst> r<src> r<amt>
+// 0x3E ROL r<dst>, r<src>, r<amt>
 // Rotate (circular shift) left.
 static inline
 void rol(Machine* self) {
@@ -458,7 +658,7 @@ void rol(Machine* self) {
   self->top->r[dst].bits = (x << amt) | (x >> (-amt & shiftMask));
 }
 
-// 0x3F ROL r<dst> r<src> imm<amt>
+// 0x3F ROL r<dst>, r<src>, imm<amt>
 // Rotate (circular shift) left immediate.
 static inline
 void rolImm(Machine* self) {
@@ -475,13 +675,20 @@ void rolImm(Machine* self) {
  ************************************/
 
 
+// The memory behind `NEW`/`FREE`/`RNEW` (and arenas) comes from the machine's
+// heap, which records the code offset of the allocating instruction for
+// statistics. With `--gc`, the instructions that allocate are also where
+// garbage gets collected (see gc.h).
+
 // 0x40 NEW r<dst>, r<src>
 // allocate src bytes and retain pointer to them in dst
 static inline
 void vmAlloc(Machine* self) {
+  maybeCollectGarbage(self);
+  uintptr_t site = self->ip - 1 - self->program->code;
   size_t dst = readVarint(&self->ip);
   size_t src = readVarint(&self->ip);
-  self->top->r[dst].bptr = malloc(self->top->r[src].bits);
+  self->top->r[dst].bptr = heapAlloc(&self->heap, self->top->r[src].bits, site);
 }
 
 // 0x41 FREE r<ptr>
@@ -493,7 +700,7 @@ void vmFree(Machine* self) {
   size_t src = readVarint(&self->ip);
   byte* ptr = self->top->r[src].bptr;
   if (ptr != NULL) {
-    free(ptr);
+    heapFree(&self->heap, ptr);
     self->top->r[src].bptr = NULL;
   }
 }
@@ -502,13 +709,31 @@ void vmFree(Machine* self) {
 // Reallocate a `NEW`-allocated pointer to be a new size.
 static inline
 void vmRealloc(Machine* self) {
+  maybeCollectGarbage(self);
+  uintptr_t site = self->ip - 1 - self->program->code;
   size_t ptr = readVarint(&self->ip);
   size_t src = readVarint(&self->ip);
-  byte* new = realloc(self->top->r[ptr].bptr, self->top->r[src].bits);
+  byte* new = heapRealloc(&self->heap, self->top->r[ptr].bptr, self->top->r[src].bits, site);
   self->top->r[ptr].bptr = new;
 }
 
-// 0x44 OFF r<dst>, reg<src>
+// 0x43 ARENA r<dst>, r<cap>
+// Create a new arena and retain a pointer to it in dst.
+// The cap register gives an initial capacity in bytes, or zero for a default.
+// If there is no memory, zero is stored in dst.
+//
+// Arenas hand out memory with `ANEW`. None of it is freed individually; it is
+// all released at once with `AFREE`.
+static inline
+void newRegion(Machine* self) {
+  maybeCollectGarbage(self);
+  uintptr_t site = self->ip - 1 - self->program->code;
+  size_t dst = readVarint(&self->ip);
+  size_t cap = readVarint(&self->ip);
+  self->top->r[dst].bptr = (byte*)newArena(&self->heap, self->top->r[cap].bits, site);
+}
+
+// 0x44 OFF r<dst>, r<src>
 // Add src * sizeof(word) to dst
 static inline
 void offset(Machine* self) {
@@ -526,6 +751,43 @@ void offsetImm(Machine* self) {
   self->top->r[dst].bits += sizeof(word) * imm;
 }
 
+// 0x46 ANEW r<dst>, r<arena>, r<src>
+// Allocate src bytes from an `ARENA` and retain pointer to them in dst.
+// The memory is aligned as for `NEW`. If there is no memory, store zero in dst.
+static inline
+void regionAlloc(Machine* self) {
+  maybeCollectGarbage(self);
+  size_t dst = readVarint(&self->ip);
+  size_t arena = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  Arena* region = (Arena*)self->top->r[arena].bptr;
+  self->top->r[dst].bptr = arenaAlloc(&self->heap, region, self->top->r[src].bits);
+}
+
+// 0x47 AFREE imm<mode>, r<arena>
+// Release all memory allocated from an `ARENA` at once.
+// The mode argument should be:
+//    0 to destroy the arena itself and clear the register (as `FREE`), or
+//    1 to keep the arena for reuse, retaining its largest block of memory.
+// If passed a register containing NULL, this is a no-op.
+static inline
+void regionFree(Machine* self) {
+  size_t mode = readVarint(&self->ip);
+  size_t arena = readVarint(&self->ip);
+  Arena* region = (Arena*)self->top->r[arena].bptr;
+  if (region == NULL) { return; }
+  switch (mode) {
+    case 0: {
+      destroyArena(&self->heap, region);
+      self->top->r[arena].bptr = NULL;
+    } break;
+    case 1: {
+      resetArena(&self->heap, region);
+    } break;
+    default: break;
+  }
+}
+
 // 0x48 MMOV r<dst>, r<src>, r<len>
 // Copy len bytes from src to dst.
 //
@@ -789,7 +1051,6 @@ void zmov(Machine* self) {
   size_t dst = readVarint(&self->ip);
   size_t src = readVarint(&self->ip);
   if (self->top->r[cond].bits == 0) {
-    fprintf(stderr, "MOVED\n");
     self->top->r[dst].bits = self->top->r[src].bits;
   }
 }
@@ -806,27 +1067,159 @@ void zmovi(Machine* self) {
   }
 }
 
+// The predicated loads and stores below always touch memory, so that they
+// need no host branch, which would mispredict on data-dependent conditions.
+// When the condition fails, they load from (or store to) a harmless place
+// instead of the given address, which need not be valid in that case.
+// That costs extra instructions, which are cheaper than the mispredictions
+// (see bench/).
+
+// Choose `a` when `c` holds and `b` otherwise, without branching.
+static inline
+word* pickAddr(bool c, word* a, word* b) {
+  uintptr_t mask = -(uintptr_t)c;
+  return (word*)(((uintptr_t)a & mask) | ((uintptr_t)b & ~mask));
+}
+
+// 0x64 CLD r<cond>, r<dst>, r<src>
+// Load a word from the address in src into dst when cond is non-zero.
+static inline
+void cld(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  word* from = pickAddr(self->top->r[cond].bits != 0, self->top->r[src].wptr, &self->top->r[dst]);
+  self->top->r[dst] = *from;
+}
+
+// 0x65 CLD r<cond>, r<dst>, r<src>, imm<off>
+// Load a word from the address src + off*sizeof(word) into dst when cond is
+// non-zero.
+static inline
+void cldOff(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t off = readVarint(&self->ip);
+  word* from = pickAddr(self->top->r[cond].bits != 0, self->top->r[src].wptr + off, &self->top->r[dst]);
+  self->top->r[dst] = *from;
+}
+
+// 0x66 ZLD r<cond>, r<dst>, r<src>
+// Load a word from the address in src into dst when cond is zero.
+static inline
+void zld(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  word* from = pickAddr(self->top->r[cond].bits == 0, self->top->r[src].wptr, &self->top->r[dst]);
+  self->top->r[dst] = *from;
+}
+
+// 0x67 ZLD r<cond>, r<dst>, r<src>, imm<off>
+// Load a word from the address src + off*sizeof(word) into dst when cond is
+// zero.
+static inline
+void zldOff(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t off = readVarint(&self->ip);
+  word* from = pickAddr(self->top->r[cond].bits == 0, self->top->r[src].wptr + off, &self->top->r[dst]);
+  self->top->r[dst] = *from;
+}
+
+// 0x68 CST r<cond>, r<dst>, r<src>
+// Store src into memory at the address in dst when cond is non-zero.
+static inline
+void cst(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  word sink;
+  *pickAddr(self->top->r[cond].bits != 0, self->top->r[dst].wptr, &sink) = self->top->r[src];
+}
+
+// 0x69 CST r<cond>, r<dst>, imm<off>, r<src>
+// Store src into memory at the address dst + off*sizeof(word) when cond is
+// non-zero.
+static inline
+void cstOff(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t off = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  word sink;
+  *pickAddr(self->top->r[cond].bits != 0, self->top->r[dst].wptr + off, &sink) = self->top->r[src];
+}
+
+// 0x6A ZST r<cond>, r<dst>, r<src>
+// Store src into memory at the address in dst when cond is zero.
+static inline
+void zst(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  word sink;
+  *pickAddr(self->top->r[cond].bits == 0, self->top->r[dst].wptr, &sink) = self->top->r[src];
+}
+
+// 0x6B ZST r<cond>, r<dst>, imm<off>, r<src>
+// Store src into memory at the address dst + off*sizeof(word) when cond is
+// zero.
+static inline
+void zstOff(Machine* self) {
+  size_t cond = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t off = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  word sink;
+  *pickAddr(self->top->r[cond].bits == 0, self->top->r[dst].wptr + off, &sink) = self->top->r[src];
+}
+
 
 /************************************
  Jumps
  ************************************/
 
+// Fuel metering: every control transfer that can start another trip through
+// code already run (taken jumps and computed jumps that do not go forward, and
+// all calls) burns one unit of `self->fuel`. Between two such transfers,
+// execution only moves forward (or returns, which needs a frame that some call
+// already paid for), so the work done is bounded by the fuel times the size of
+// the code.
+//
+// Whether a static jump burns fuel is fixed by the sign of its encoded offset,
+// so the check is a single subtract-and-branch that only lives in the
+// block-ending instructions. When the tank runs dry, the transfer still
+// completes and the machine halts with `ip`/`top` intact; see `refuel`.
+static inline
+void burn(Machine* self, uint64_t cost) {
+  self->fuel -= cost;
+  if (self->fuel == 0) {
+    self->shouldHalt = true;
+  }
+}
+
 
 // 0x70 JMPR r<src>
 // computed jump (jump to address held in addr register)
 static inline
 void computedJump(Machine* self) {
+  byte* here = self->ip - 1;
   size_t src = readVarint(&self->ip);
   self->ip = self->top->r[src].bptr;
+  burn(self, self->ip <= here);
 }
 
-// 0x71 JMP imm<off>
+// 0x71 JMP i32<offset>
 // unconditional jump
 static inline
 void jump(Machine* self) {
   byte* here = self->ip - 1;
   ptrdiff_t offset = readI32(&self->ip);
   self->ip = here + offset;
+  burn(self, offset <= 0);
 }
 
 // 0x72 CJMP r<cond>, i32<offset>
@@ -838,6 +1231,7 @@ void cjump(Machine* self) {
   ptrdiff_t offset = readI32(&self->ip);
   if (self->top->r[cond].bits) {
     self->ip = here + offset;
+    burn(self, offset <= 0);
   }
 }
 
@@ -850,6 +1244,7 @@ void zjump(Machine* self) {
   ptrdiff_t offset = readI32(&self->ip);
   if (!self->top->r[cond].bits) {
     self->ip = here + offset;
+    burn(self, offset <= 0);
   }
 }
 
@@ -859,6 +1254,48 @@ void zjump(Machine* self) {
  Subroutines
  ************************************/
 
+// Indirect calls look their target up in the machine's call cache, keyed by
+// the address of the calling instruction. A hit skips decoding the callee's
+// frame size; a miss decodes it and remembers it for next time, evicting the
+// least recent of the targets seen at that site. Only targets in the program's
+// code are cached, since the loader makes that read-only (see loader.c), so
+// the frame size there can't change under the cache.
+static inline
+byte* enterIndirect(Machine* self, const byte* site, byte* tgt, size_t* frameSize_words) {
+  const Program* prog = self->program;
+  if (tgt < prog->code || tgt >= prog->code + prog->codeSize_bytes) {
+    *frameSize_words = readU32(&tgt);
+    return tgt;
+  }
+  CallCacheSlot* slot = &self->callCache[(uintptr_t)site % CALL_CACHE_SLOTS];
+  if (slot->site == site) {
+    if (slot->way[0].target == tgt) {
+      *frameSize_words = slot->way[0].frameSize_words;
+      return tgt + 4;
+    }
+    for (size_t i = 1; i < CALL_CACHE_WAYS; ++i) {
+      if (slot->way[i].target == tgt) {
+        *frameSize_words = slot->way[i].frameSize_words;
+        // move to front
+        slot->way[i] = slot->way[0];
+        slot->way[0].target = tgt;
+        slot->way[0].frameSize_words = *frameSize_words;
+        return tgt + 4;
+      }
+    }
+  }
+  else {
+    slot->site = site;
+    for (size_t i = 0; i < CALL_CACHE_WAYS; ++i) { slot->way[i].target = NULL; }
+  }
+  byte* entry = tgt;
+  *frameSize_words = readU32(&entry);
+  memmove(&slot->way[1], &slot->way[0], sizeof(slot->way[0]) * (CALL_CACHE_WAYS - 1));
+  slot->way[0].target = tgt;
+  slot->way[0].frameSize_words = *frameSize_words;
+  return entry;
+}
+
 // 0x80 JAL r<tgt>, imm<n>, n * r<src>
 // Jump and link to address stored in tgt register.
 //
@@ -866,11 +1303,13 @@ void zjump(Machine* self) {
 static inline
 void jalr(Machine* self) {
   // accumulate information about callee
-  size_t reg = readI32(&self->ip);
-  byte* tgt = self->top->r[reg].bptr;
-  size_t calleeSize_words = readU32(&tgt);
+  byte* here = self->ip - 1;
+  size_t reg = readVarint(&self->ip);
+  size_t calleeSize_words;
+  byte* tgt = enterIndirect(self, here, self->top->r[reg].bptr, &calleeSize_words);
   // setup callee stack frame
   StackFrame* callee = malloc(sizeof(StackFrame) + sizeof(word) * calleeSize_words);
+  callee->size_words = calleeSize_words;
   callee->prev = self->top;
   size_t argument_count = readVarint(&self->ip);
   for(size_t i = 1; i <= argument_count; ++i) {
@@ -881,6 +1320,7 @@ void jalr(Machine* self) {
   // push callee frame and jump
   self->top = callee;
   self->ip = tgt;
+  burn(self, 1);
 }
 
 // 0x81 JAL i32<offset>, imm<n>, n * r<src>
@@ -902,6 +1342,7 @@ void jal(Machine* self) {
   size_t calleeSize_words = readU32(&tgt);
   // setup callee stack frame
   StackFrame* callee = malloc(sizeof(StackFrame) + sizeof(word) * calleeSize_words);
+  callee->size_words = calleeSize_words;
   callee->prev = self->top;
   size_t argument_count = readVarint(&self->ip);
   for(size_t i = 1; i <= argument_count; ++i) {
@@ -912,6 +1353,7 @@ void jal(Machine* self) {
   // push callee frame and jump
   self->top = callee;
   self->ip = tgt;
+  burn(self, 1);
 }
 
 // 0x82 JAR r<tgt>, imm<n>, n * r<src>
@@ -920,10 +1362,12 @@ void jal(Machine* self) {
 // As 0x83, but with a register source rather than an immediate offset.
 static inline
 void jarr(Machine* self) {
-  size_t reg = readI32(&self->ip);
-  byte* tgt = self->top->r[reg].bptr;
-  size_t calleeSize_words = readU32(&tgt);
+  byte* here = self->ip - 1;
+  size_t reg = readVarint(&self->ip);
+  size_t calleeSize_words;
+  byte* tgt = enterIndirect(self, here, self->top->r[reg].bptr, &calleeSize_words);
   StackFrame* callee = malloc(sizeof(StackFrame) + sizeof(word) * calleeSize_words);
+  callee->size_words = calleeSize_words;
   callee->prev = self->top->prev; // <-- this is different from jal
   size_t argument_count = readVarint(&self->ip);
   for(size_t i = 1; i <= argument_count; ++i) {
@@ -934,9 +1378,10 @@ void jarr(Machine* self) {
   free(self->top); // <-- this is an extra step relative to jal
   self->top = callee;
   self->ip = tgt;
+  burn(self, 1);
 }
 
-// 0x83 JAR
+// 0x83 JAR i32<offset>, imm<n>, n * r<src>
 // "Jump-and-relink".
 // As JAL, but the next stack frame will return not to this frame, but the previous one.
 // That is, this implements a tail call.
@@ -947,6 +1392,7 @@ void jar(Machine* self) {
   byte* tgt = here + offset;
   size_t calleeSize_words = readU32(&tgt);
   StackFrame* callee = malloc(sizeof(StackFrame) + sizeof(word) * calleeSize_words);
+  callee->size_words = calleeSize_words;
   callee->prev = self->top->prev; // <-- this is different from jal
   size_t argument_count = readVarint(&self->ip);
   for(size_t i = 1; i <= argument_count; ++i) {
@@ -957,6 +1403,7 @@ void jar(Machine* self) {
   free(self->top); // <-- this is an extra step relative to jal
   self->top = callee;
   self->ip = tgt;
+  burn(self, 1);
 }
 
 // 0x84 RET imm<n>, n * r<src...>
@@ -1012,110 +1459,969 @@ void exit_(Machine* self) {
   self->shouldHalt = true;
 }
 
-// 0xC0 STRM r<dst> imm<id>
-// Load a file handle into the destination based on the id: either
-//   standard input (id = 0),
-//   standard outut (id = 1), or
-//   standard error (id = 3).
-// Other values of id are leave the destination register undefined
+// 0x87 SNAP r<dst>
+// Save an image of the whole machine, to be resumed later with
+// `bsvm --restore`, and store 0 in dst.
+// When the image is restored, execution continues after this instruction, but
+// with 1 in dst instead. If no image could be written (or the host did not ask
+// for one), store -1 in dst.
+//
+// See snapshot.h for what does and does not survive the trip.
 static inline
-void strm(Machine* self) {
+void snap(Machine* self) {
   size_t dst = readVarint(&self->ip);
-  size_t id = readVarint(&self->ip);
-  FILE* res;
-  switch (id) {
-    case 0: res = stdin; break;
-    case 1: res = stdout; break;
-    case 2: res = stderr; break;
-    default: res = NULL; break;
+  if (self->snapshotPath == NULL) {
+    self->top->r[dst].sbits = -1;
+    return;
   }
-  self->top->r[dst].fptr = res;
+  self->top->r[dst].bits = 1;
+  int err = writeSnapshot(self, self->snapshotPath);
+  self->top->r[dst].sbits = err ? -1 : 0;
 }
 
-// 0xC1 ENV r<dst>, r<src>
-// Lookup the variable name from src in the process' environment.
-// Store pointer to the result in the dst register.
-// Both strings are NUL-terminated.
-// If the environment does not define the given variable, the dst is set to zero.
-
 
-// 0xC2 ARGC r<dst>
-// Load number of arguments (including bytecode filepath) into dst.
-static inline
-void getArgc(Machine* self) {
-  size_t dst = readVarint(&self->ip);
-  self->top->r[dst].bits = self->environ.argc;
-}
+/************************************
+ Sized Memory Access
+ ************************************/
 
-// 0xC3 ARGV r<dst>, r<ix>
-// Create a handle to a copy of the ix-th argument.
-// The handle is two words: a length and a pointer to a NUL-terminated string of that length.
-// The pointer is global, and so should not be freed/mutated.
-// The handle is written to the contents of the pointer stored in dst.
-static inline
-void getArgv(Machine* self) {
-  size_t dst = readVarint(&self->ip);
-  size_t ix = readVarint(&self->ip);
-  char* nulstrp = self->environ.argv[self->top->r[ix].bits];
-  word* tgt = self->top->r[dst].wptr;
-  tgt[0].bits = strlen(nulstrp);
-  tgt[1].bptr = (byte*)nulstrp;
+// These read and write integers narrower than a word (or exactly a word) at
+// any alignment, in either byte order. The `fmt` byte describes the integer:
+//   bits 0-1: log2 of its size in bytes (so 1, 2, 4, or 8 bytes)
+//   bit 2: when set, loads sign-extend rather than zero-extend
+//   bit 3: when set, it is big-endian rather than little-endian
+// Other bits must be clear. Sizes larger than a word are truncated to one.
+// Offsets are in bytes (unlike `LD`/`ST`), and may be negative.
+
+#define FMT_SIZE 0x03
+#define FMT_SIGNED 0x04
+#define FMT_BIG_ENDIAN 0x08
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  #define FMT_NATIVE 0
+#else
+  #define FMT_NATIVE FMT_BIG_ENDIAN
+#endif
+
+static inline
+uintptr_t loadSized(const byte* from, byte fmt) {
+  bool swap = (fmt & FMT_BIG_ENDIAN) != FMT_NATIVE;
+  bool sext = fmt & FMT_SIGNED;
+  switch (fmt & FMT_SIZE) {
+    case 0: {
+      uint8_t x = *from;
+      return sext ? (uintptr_t)(int8_t)x : x;
+    }
+    case 1: {
+      uint16_t x;
+      memcpy(&x, from, sizeof(x));
+      if (swap) { x = __builtin_bswap16(x); }
+      return sext ? (uintptr_t)(int16_t)x : x;
+    }
+    case 2: {
+      uint32_t x;
+      memcpy(&x, from, sizeof(x));
+      if (swap) { x = __builtin_bswap32(x); }
+      return sext ? (uintptr_t)(int32_t)x : x;
+    }
+    default: {
+      uint64_t x;
+      memcpy(&x, from, sizeof(x));
+      if (swap) { x = __builtin_bswap64(x); }
+      return sext ? (uintptr_t)(int64_t)x : (uintptr_t)x;
+    }
+  }
 }
 
-// 0xD0 OPEN imm<mode>, r<dst>, r<src>
-// Opens the file names in src and places the file pointer in dst.
-// The src register should have a pointer to a NUL-terminated string.
-// The mode argument should be:
-//    0 for read,
-//    1 for write (create file if it doesn't exist),
-//    2 for read/write (create file if it doesn't exist).
-// If there is an error, zero is stored in dst.
 static inline
-void openFile(Machine* self) {
-  size_t mode = readVarint(&self->ip);
-  size_t dst = readVarint(&self->ip);
-  size_t src = readVarint(&self->ip);
-  switch (mode) {
+void storeSized(byte* to, byte fmt, uintptr_t val) {
+  bool swap = (fmt & FMT_BIG_ENDIAN) != FMT_NATIVE;
+  switch (fmt & FMT_SIZE) {
     case 0: {
-      self->top->r[dst].fptr = fopen((char*)self->top->r[src].bptr, "r");
+      *to = val;
     } break;
     case 1: {
-      self->top->r[dst].fptr = fopen((char*)self->top->r[src].bptr, "w");
+      uint16_t x = val;
+      if (swap) { x = __builtin_bswap16(x); }
+      memcpy(to, &x, sizeof(x));
     } break;
     case 2: {
-      FILE* file = fopen((char*)self->top->r[src].bptr, "a+");
-      fseek(file, 0, SEEK_SET);
-      self->top->r[dst].fptr = file;
+      uint32_t x = val;
+      if (swap) { x = __builtin_bswap32(x); }
+      memcpy(to, &x, sizeof(x));
     } break;
     default: {
-      self->top->r[dst].fptr = NULL;
-    }; break;
+      uint64_t x = val;
+      if (swap) { x = __builtin_bswap64(x); }
+      memcpy(to, &x, sizeof(x));
+    } break;
   }
 }
 
-// 0xD1 CLOS r<fp>
-// Close a file.
-// This may or may not successfully flush any buffered output.
+// 0x90 LDX byte<fmt>, r<dst>, r<src>
+// Load an integer described by fmt from the address in src and place it in dst.
 static inline
-void closeFile(Machine* self) {
-  size_t fp = readVarint(&self->ip);
-  fclose(self->top->r[fp].fptr);
+void loadSizedReg(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  self->top->r[dst].bits = loadSized(self->top->r[src].bptr, fmt);
 }
 
-// 0xD2 GET r<dst>, r<fp>, r<src>
-// Read bytes from the file handle in fp to a buffer pointed to by dst.
-// The src register contains the maximum number of bytes that should be read.
-// At the end of the operation, store the number of bytes actually read in src.
-// If there was an error, store `-read_bytes - 1` in src.
+// 0x91 LDX byte<fmt>, r<dst>, r<src>, imm<off>
+// Load an integer described by fmt from the address src + off and place it in dst.
 static inline
-void getBytes(Machine* self) {
+void loadSizedOff(Machine* self) {
+  byte fmt = *self->ip++;
   size_t dst = readVarint(&self->ip);
-  size_t fp = readVarint(&self->ip);
   size_t src = readVarint(&self->ip);
-  FILE* file = self->top->r[fp].fptr;
-  size_t req_read = self->top->r[src].bits;
-  size_t real_read = fread(self->top->r[dst].bptr, 1, req_read, file);
-  if (req_read == real_read) {
+  ptrdiff_t off = readVarint(&self->ip);
+  self->top->r[dst].bits = loadSized(self->top->r[src].bptr + off, fmt);
+}
+
+// 0x92 STX byte<fmt>, r<dst>, r<src>
+// Store src as an integer described by fmt into memory at the address in dst.
+static inline
+void storeSizedReg(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  storeSized(self->top->r[dst].bptr, fmt, self->top->r[src].bits);
+}
+
+// 0x93 STX byte<fmt>, r<dst>, imm<off>, r<src>
+// Store src as an integer described by fmt into memory at the address dst + off.
+static inline
+void storeSizedOff(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t dst = readVarint(&self->ip);
+  ptrdiff_t off = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  storeSized(self->top->r[dst].bptr + off, fmt, self->top->r[src].bits);
+}
+
+
+/************************************
+ Multi-word Arithmetic
+ ************************************/
+
+// These work on little-endian arrays of len words ("limbs") in memory, so that
+// a whole carry chain over a multiprecision number is a single instruction.
+// The destination may be the same array as the source, but they must not
+// otherwise overlap.
+
+// 0x94 ADCN r<carry>, r<dst>, r<src>, r<len>
+// dst[0..len) += src[0..len) + carry, with the carry out (0 or 1) left in carry.
+static inline
+void adcN(Machine* self) {
+  size_t carry = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  word* d = self->top->r[dst].wptr;
+  const word* s = self->top->r[src].wptr;
+  uintptr_t c = self->top->r[carry].bits ? 1 : 0;
+  for (uintptr_t i = 0, n = self->top->r[len].bits; i < n; ++i) {
+    uintptr_t x = d[i].bits;
+    uintptr_t y = x + s[i].bits + c;
+    c = c ? y <= x : y < x;
+    d[i].bits = y;
+  }
+  self->top->r[carry].bits = c;
+}
+
+// 0x95 SBBN r<borrow>, r<dst>, r<src>, r<len>
+// dst[0..len) -= src[0..len) + borrow, with the borrow out (0 or 1) left in
+// borrow.
+static inline
+void sbbN(Machine* self) {
+  size_t borrow = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  word* d = self->top->r[dst].wptr;
+  const word* s = self->top->r[src].wptr;
+  uintptr_t b = self->top->r[borrow].bits ? 1 : 0;
+  for (uintptr_t i = 0, n = self->top->r[len].bits; i < n; ++i) {
+    uintptr_t x = d[i].bits;
+    uintptr_t y = x - s[i].bits - b;
+    b = b ? y >= x : y > x;
+    d[i].bits = y;
+  }
+  self->top->r[borrow].bits = b;
+}
+
+// 0x96 MACN r<carry>, r<dst>, r<src>, r<len>, r<m>
+// Multiply-accumulate: dst[0..len) += src[0..len) * m + carry, where the carry
+// in and out is a whole word (the part of the sum that overflows dst).
+// This is the inner loop of schoolbook multiplication.
+static inline
+void macN(Machine* self) {
+  size_t carry = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  size_t mul = readVarint(&self->ip);
+  word* d = self->top->r[dst].wptr;
+  const word* s = self->top->r[src].wptr;
+  dword m = self->top->r[mul].bits;
+  uintptr_t c = self->top->r[carry].bits;
+  for (uintptr_t i = 0, n = self->top->r[len].bits; i < n; ++i) {
+    // cannot overflow: (2^w - 1)^2 + 2 * (2^w - 1) < 2^2w
+    dword t = s[i].bits * m + d[i].bits + c;
+    d[i].bits = (uintptr_t)t;
+    c = (uintptr_t)(t >> (CHAR_BIT * sizeof(uintptr_t)));
+  }
+  self->top->r[carry].bits = c;
+}
+
+// 0x97 DIVN r<rem>, r<dst>, r<src>, r<len>, r<d>
+// Divide the number in src[0..len) by the single word d, putting the quotient
+// in dst[0..len). The remainder is left in rem, which must start out below d
+// (normally zero); it is the high word of the dividend.
+static inline
+void divN(Machine* self) {
+  size_t rem = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  size_t div = readVarint(&self->ip);
+  word* q = self->top->r[dst].wptr;
+  const word* s = self->top->r[src].wptr;
+  uintptr_t denom = self->top->r[div].bits;
+  uintptr_t r = self->top->r[rem].bits;
+  for (uintptr_t i = self->top->r[len].bits; i-- > 0;) {
+    dword numer = ((dword)r << (CHAR_BIT * sizeof(uintptr_t))) | s[i].bits;
+    q[i].bits = (uintptr_t)(numer / denom);
+    r = (uintptr_t)(numer % denom);
+  }
+  self->top->r[rem].bits = r;
+}
+
+
+/************************************
+ Hashing
+ ************************************/
+
+// `HASH` is wyhash (final version 4, by Wang Yi), a fast non-cryptographic hash
+// that eats eight bytes per multiply. Its output is the same on every host of
+// the same byte order, so it may be stored, but it is no defence against an
+// adversary picking keys to collide.
+
+static const uint64_t hashSecret[4] =
+  { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+// Multiply out to 128 bits, returning the low and high halves in a and b.
+static inline
+void hashMum(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline
+uint64_t hashMix(uint64_t a, uint64_t b) {
+  hashMum(&a, &b);
+  return a ^ b;
+}
+
+static inline
+uint64_t hashRead8(const byte* p) {
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  x = __builtin_bswap64(x);
+#endif
+  return x;
+}
+
+static inline
+uint64_t hashRead4(const byte* p) {
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  x = __builtin_bswap32(x);
+#endif
+  return x;
+}
+
+static
+uint64_t hashBytes(const byte* p, size_t len, uint64_t seed) {
+  const uint64_t* s = hashSecret;
+  seed ^= hashMix(seed ^ s[0], s[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (hashRead4(p) << 32) | hashRead4(p + ((len >> 3) << 2));
+      b = (hashRead4(p + len - 4) << 32) | hashRead4(p + len - 4 - ((len >> 3) << 2));
+    }
+    else if (len > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    }
+    else {
+      a = b = 0;
+    }
+  }
+  else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = hashMix(hashRead8(p) ^ s[1], hashRead8(p + 8) ^ seed);
+        see1 = hashMix(hashRead8(p + 16) ^ s[2], hashRead8(p + 24) ^ see1);
+        see2 = hashMix(hashRead8(p + 32) ^ s[3], hashRead8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = hashMix(hashRead8(p) ^ s[1], hashRead8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = hashRead8(p + i - 16);
+    b = hashRead8(p + i - 8);
+  }
+  a ^= s[1];
+  b ^= seed;
+  hashMum(&a, &b);
+  return hashMix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+// 0x98 HASH r<dst>, r<src>, r<len>, r<seed>
+// Hash len bytes starting at the address in src, and store the hash in dst.
+// Different seeds give unrelated hashes of the same bytes.
+static inline
+void hash(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  size_t seed = readVarint(&self->ip);
+  self->top->r[dst].bits = (uintptr_t)hashBytes(self->top->r[src].bptr, self->top->r[len].bits, self->top->r[seed].bits);
+}
+
+
+/************************************
+ Number Formatting
+ ************************************/
+
+// `FMT` and `PARS` convert between words and their text. The `fmt` byte says
+// which text:
+//   bit 0: when set, hexadecimal (upper case on output) rather than decimal
+//   bit 1: when set, the word is signed, and negative numbers have a '-'
+//   bit 2: when set, `FMT` pads with spaces rather than zeros
+// Other bits must be clear. There is never a prefix or suffix for the base.
+//
+// Without padding, `FMT` writes at most 21 bytes on a 64-bit host (11 on a
+// 32-bit one), so three words of buffer are always enough for it.
+
+#define NUM_HEX 0x01
+#define NUM_SIGNED 0x02
+#define NUM_SPACES 0x04
+#define FMT_MAX_DIGITS (sizeof(uintptr_t) * 5 / 2)
+
+static const char decimalPairs[200] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+// Write the digits of val backwards, ending just before `end`, and return
+// where they start.
+static inline
+byte* formatDigits(byte* end, uintptr_t val, bool hex) {
+  if (hex) {
+    do {
+      *--end = "0123456789ABCDEF"[val & 0xF];
+      val >>= 4;
+    } while (val != 0);
+    return end;
+  }
+  while (val >= 100) {
+    const char* pair = &decimalPairs[2 * (val % 100)];
+    val /= 100;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  if (val >= 10) {
+    *--end = decimalPairs[2 * val + 1];
+    *--end = decimalPairs[2 * val];
+  }
+  else {
+    *--end = '0' + val;
+  }
+  return end;
+}
+
+// 0x99 FMT byte<fmt>, r<len>, r<dst>, r<src>, r<width>
+// Write the number in src, as described by fmt, to the address in dst.
+// If it is shorter than width bytes, it is padded on the left up to that width.
+// Store the number of bytes written in len.
+static inline
+void formatNumber(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t len = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t width = readVarint(&self->ip);
+  uintptr_t val = self->top->r[src].bits;
+  bool neg = (fmt & NUM_SIGNED) && self->top->r[src].sbits < 0;
+  if (neg) { val = -val; }
+  byte digits[FMT_MAX_DIGITS];
+  byte* start = formatDigits(digits + sizeof(digits), val, fmt & NUM_HEX);
+  size_t ndigits = digits + sizeof(digits) - start;
+  size_t pad = self->top->r[width].bits;
+  pad = pad > ndigits + neg ? pad - ndigits - neg : 0;
+  byte* out = self->top->r[dst].bptr;
+  // zeros go between the sign and the digits, spaces before the sign
+  if (fmt & NUM_SPACES) {
+    memset(out, ' ', pad);
+    out += pad;
+  }
+  if (neg) { *out++ = '-'; }
+  if (!(fmt & NUM_SPACES)) {
+    memset(out, '0', pad);
+    out += pad;
+  }
+  memcpy(out, start, ndigits);
+  self->top->r[len].bits = pad + neg + ndigits;
+}
+
+// 0x9A PARS byte<fmt>, r<err>, r<dst>, r<len>, r<src>
+// Read a number, as described by fmt, from the start of the len bytes at the
+// address in src, stopping at the first byte that is not a digit. Signed
+// numbers may start with '-' or '+'. Hexadecimal digits may be either case.
+// Store the number in dst, and the number of bytes it took up in len.
+// Store 0 in err if there was a number, 1 if there were no digits, or 2 if the
+// number does not fit in a word. On error, dst is 0; len is 0 if there were no
+// digits, or still covers them if there were too many.
+static inline
+void parseNumber(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t err = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  const byte* p = self->top->r[src].bptr;
+  const byte* end = p + self->top->r[len].bits;
+  bool neg = false;
+  if ((fmt & NUM_SIGNED) && p < end && (*p == '-' || *p == '+')) {
+    neg = *p++ == '-';
+  }
+  uintptr_t limit = (fmt & NUM_SIGNED) ? (uintptr_t)INTPTR_MAX + neg : UINTPTR_MAX;
+  unsigned radix = (fmt & NUM_HEX) ? 16 : 10;
+  const byte* digits = p;
+  uintptr_t val = 0;
+  bool overflow = false;
+  for (; p < end; ++p) {
+    unsigned d;
+    if ('0' <= *p && *p <= '9') { d = *p - '0'; }
+    else if (radix == 16 && 'A' <= (*p & ~0x20) && (*p & ~0x20) <= 'F') { d = (*p & ~0x20) - 'A' + 10; }
+    else { break; }
+    if (val > (limit - d) / radix) { overflow = true; }
+    val = val * radix + d;
+  }
+  if (p == digits || overflow) {
+    self->top->r[err].bits = p == digits ? 1 : 2;
+    self->top->r[dst].bits = 0;
+    self->top->r[len].bits = p == digits ? 0 : p - self->top->r[src].bptr;
+    return;
+  }
+  self->top->r[err].bits = 0;
+  self->top->r[dst].bits = neg ? -val : val;
+  self->top->r[len].bits = p - self->top->r[src].bptr;
+}
+
+
+/************************************
+ Sorting
+ ************************************/
+
+// These work on arrays of records, each `stride` words long, ordered by the
+// word `key` words into each record. For a plain array of words, the stride is
+// 1 and the key 0. The `fmt` byte says how keys compare:
+//   bit 0: when set, keys are signed rather than unsigned
+// Other bits must be clear.
+//
+// `SORT` is a least-significant-digit radix sort, a byte per pass, which skips
+// the passes where every key has the same byte. It needs a scratch copy of the
+// array, and if that can't be allocated, or the array is short, it falls back
+// to insertion sort. Either way, it is stable.
+
+#define ORD_SIGNED 0x01
+#define SORT_SHORT 32
+
+// Map keys to unsigned words that compare in the same order.
+static inline
+uintptr_t sortKey(word w, byte fmt) {
+  return (fmt & ORD_SIGNED) ? w.bits ^ ((uintptr_t)1 << (WORD_BITS - 1)) : w.bits;
+}
+
+static
+void insertionSort(word* arr, size_t len, size_t stride, size_t key, byte fmt) {
+  for (size_t i = 1; i < len; ++i) {
+    // swap the record down, a word at a time, until it is in place
+    for (word* p = &arr[i * stride]; p != arr && sortKey((p - stride)[key], fmt) > sortKey(p[key], fmt); p -= stride) {
+      for (size_t w = 0; w < stride; ++w) {
+        word tmp = p[w];
+        p[w] = (p - stride)[w];
+        (p - stride)[w] = tmp;
+      }
+    }
+  }
+}
+
+static
+void radixSort(word* arr, size_t len, size_t stride, size_t key, byte fmt) {
+  if (len < 2 || stride == 0) { return; }
+  word* scratch = len <= SORT_SHORT ? NULL : malloc(len * stride * sizeof(word));
+  if (scratch == NULL) {
+    insertionSort(arr, len, stride, key, fmt);
+    return;
+  }
+  // count every byte position's digits in one go
+  size_t counts[sizeof(uintptr_t)][256] = {{0}};
+  for (size_t i = 0; i < len; ++i) {
+    uintptr_t k = sortKey(arr[i * stride + key], fmt);
+    for (size_t d = 0; d < sizeof(uintptr_t); ++d) {
+      ++counts[d][(k >> (8 * d)) & 0xFF];
+    }
+  }
+  word* from = arr;
+  word* to = scratch;
+  for (size_t d = 0; d < sizeof(uintptr_t); ++d) {
+    size_t* count = counts[d];
+    uintptr_t first = (sortKey(arr[key], fmt) >> (8 * d)) & 0xFF;
+    if (count[first] == len) { continue; }
+    size_t at = 0;
+    for (size_t b = 0; b < 256; ++b) {
+      size_t n = count[b];
+      count[b] = at;
+      at += n;
+    }
+    for (size_t i = 0; i < len; ++i) {
+      uintptr_t b = (sortKey(from[i * stride + key], fmt) >> (8 * d)) & 0xFF;
+      size_t j = count[b]++;
+      if (stride == 1) { to[j] = from[i]; }
+      else { memcpy(&to[j * stride], &from[i * stride], stride * sizeof(word)); }
+    }
+    word* tmp = from;
+    from = to;
+    to = tmp;
+  }
+  if (from != arr) {
+    memcpy(arr, from, len * stride * sizeof(word));
+  }
+  free(scratch);
+}
+
+// 0x9B SORT byte<fmt>, r<arr>, r<len>, imm<stride>, imm<key>
+// Sort the len records at the address in arr into ascending order of their keys.
+// Records with equal keys keep their order.
+static inline
+void sortRecords(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t arr = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  size_t stride = readVarint(&self->ip);
+  size_t key = readVarint(&self->ip);
+  radixSort(self->top->r[arr].wptr, self->top->r[len].bits, stride, key, fmt);
+}
+
+// 0x9C BSRC byte<fmt>, r<dst>, r<arr>, r<len>, r<val>, imm<stride>, imm<key>
+// Search the len records at the address in arr, which must be sorted, for the
+// first one whose key is not less than val, and store its index in dst.
+// If every key is less than val, store len in dst.
+static inline
+void searchRecords(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t dst = readVarint(&self->ip);
+  size_t arr = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  size_t val = readVarint(&self->ip);
+  size_t stride = readVarint(&self->ip);
+  size_t key = readVarint(&self->ip);
+  const word* base = self->top->r[arr].wptr;
+  uintptr_t k = sortKey(self->top->r[val], fmt);
+  size_t lo = 0;
+  size_t n = self->top->r[len].bits;
+  while (n > 0) {
+    size_t half = n / 2;
+    bool below = sortKey(base[(lo + half) * stride + key], fmt) < k;
+    lo = below ? lo + half + 1 : lo;
+    n = below ? n - half - 1 : half;
+  }
+  self->top->r[dst].bits = lo;
+}
+
+// 0x9D MERG byte<fmt>, r<dst>, r<src1>, r<len1>, r<src2>, r<len2>, imm<stride>, imm<key>
+// Merge the len1 records at src1 and the len2 records at src2, both sorted,
+// into len1 + len2 sorted records at dst, which must not overlap either.
+// Of records with equal keys, those from src1 come first.
+static inline
+void mergeRecords(Machine* self) {
+  byte fmt = *self->ip++;
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t len1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+  size_t len2 = readVarint(&self->ip);
+  size_t stride = readVarint(&self->ip);
+  size_t key = readVarint(&self->ip);
+  word* out = self->top->r[dst].wptr;
+  const word* a = self->top->r[src1].wptr;
+  const word* b = self->top->r[src2].wptr;
+  const word* aEnd = a + self->top->r[len1].bits * stride;
+  const word* bEnd = b + self->top->r[len2].bits * stride;
+  while (a != aEnd && b != bEnd) {
+    bool takeB = sortKey(b[key], fmt) < sortKey(a[key], fmt);
+    const word* from = takeB ? b : a;
+    memcpy(out, from, stride * sizeof(word));
+    out += stride;
+    a += takeB ? 0 : stride;
+    b += takeB ? stride : 0;
+  }
+  memcpy(out, a, (aEnd - a) * sizeof(word));
+  out += aEnd - a;
+  memcpy(out, b, (bEnd - b) * sizeof(word));
+}
+
+
+/************************************
+ Vectors
+ ************************************/
+
+// A vector is sixteen bytes (its "lanes") held in consecutive registers,
+// starting from the one named: two registers on a 64-bit host, or four on a
+// 32-bit one. The frame must have room for all of them. Vectors in memory need
+// not be aligned.
+//
+// With SSE2 (which every x86-64 has) these are single instructions, as is
+// `VSHUF` with SSSE3; otherwise, they are loops over the lanes that compilers
+// are generally able to vectorize.
+
+#define VEC_BYTES 16
+_Static_assert(VEC_BYTES % sizeof(word) == 0, "vectors must fill whole registers");
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+  #define VEC_GET(reg) _mm_loadu_si128((const __m128i*)&self->top->r[reg])
+  #define VEC_PUT(reg, v) _mm_storeu_si128((__m128i*)&self->top->r[reg], (v))
+#endif
+#ifdef __SSSE3__
+  #include <tmmintrin.h>
+#endif
+
+typedef struct Vec Vec;
+struct Vec { byte lane[VEC_BYTES]; };
+
+static inline
+Vec vecGet(Machine* self, size_t reg) {
+  Vec out;
+  memcpy(&out, &self->top->r[reg], VEC_BYTES);
+  return out;
+}
+
+static inline
+void vecPut(Machine* self, size_t reg, const Vec* v) {
+  memcpy(&self->top->r[reg], v, VEC_BYTES);
+}
+
+// 0xA0 VLD r<dst>, r<src>
+// Load the sixteen bytes at the address in src into the vector dst.
+static inline
+void vecLoad(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  memcpy(&self->top->r[dst], self->top->r[src].bptr, VEC_BYTES);
+}
+
+// 0xA1 VST r<dst>, r<src>
+// Store the vector src into the sixteen bytes at the address in dst.
+static inline
+void vecStore(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  memcpy(self->top->r[dst].bptr, &self->top->r[src], VEC_BYTES);
+}
+
+// 0xA2 VSPL r<dst>, r<src>
+// "Splat": fill every lane of the vector dst with the low byte of src.
+static inline
+void vecSplat(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  Vec v;
+  memset(&v, self->top->r[src].byte.low, VEC_BYTES);
+  vecPut(self, dst, &v);
+}
+
+// 0xA3 VEQ r<dst>, r<src1>, r<src2>
+// Set each lane of dst to 0xFF where the lanes of src1 and src2 are equal,
+// and to zero elsewhere.
+static inline
+void vecEq(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+#ifdef __SSE2__
+  VEC_PUT(dst, _mm_cmpeq_epi8(VEC_GET(src1), VEC_GET(src2)));
+#else
+  Vec a = vecGet(self, src1), b = vecGet(self, src2);
+  for (int i = 0; i < VEC_BYTES; ++i) { a.lane[i] = a.lane[i] == b.lane[i] ? 0xFF : 0; }
+  vecPut(self, dst, &a);
+#endif
+}
+
+// 0xA4 VBL r<dst>, r<src1>, r<src2>
+// Set each lane of dst to 0xFF where the lane of src1 is below (unsigned less
+// than) that of src2, and to zero elsewhere.
+static inline
+void vecBelow(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+#ifdef __SSE2__
+  // SSE2 only compares signed bytes, so shift both into that range first
+  __m128i bias = _mm_set1_epi8((char)0x80);
+  VEC_PUT(dst, _mm_cmplt_epi8(_mm_xor_si128(VEC_GET(src1), bias), _mm_xor_si128(VEC_GET(src2), bias)));
+#else
+  Vec a = vecGet(self, src1), b = vecGet(self, src2);
+  for (int i = 0; i < VEC_BYTES; ++i) { a.lane[i] = a.lane[i] < b.lane[i] ? 0xFF : 0; }
+  vecPut(self, dst, &a);
+#endif
+}
+
+// 0xA5 VADD r<dst>, r<src1>, r<src2>
+// Add the lanes of src1 and src2, wrapping around on overflow.
+static inline
+void vecAdd(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+#ifdef __SSE2__
+  VEC_PUT(dst, _mm_add_epi8(VEC_GET(src1), VEC_GET(src2)));
+#else
+  Vec a = vecGet(self, src1), b = vecGet(self, src2);
+  for (int i = 0; i < VEC_BYTES; ++i) { a.lane[i] += b.lane[i]; }
+  vecPut(self, dst, &a);
+#endif
+}
+
+// 0xA6 VSUB r<dst>, r<src1>, r<src2>
+// Subtract the lanes of src2 from those of src1, wrapping around on overflow.
+static inline
+void vecSub(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+#ifdef __SSE2__
+  VEC_PUT(dst, _mm_sub_epi8(VEC_GET(src1), VEC_GET(src2)));
+#else
+  Vec a = vecGet(self, src1), b = vecGet(self, src2);
+  for (int i = 0; i < VEC_BYTES; ++i) { a.lane[i] -= b.lane[i]; }
+  vecPut(self, dst, &a);
+#endif
+}
+
+// 0xA7 VAND r<dst>, r<src1>, r<src2>
+static inline
+void vecAnd(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+  for (size_t i = 0; i < VEC_BYTES / sizeof(word); ++i) {
+    self->top->r[dst + i].bits = self->top->r[src1 + i].bits & self->top->r[src2 + i].bits;
+  }
+}
+
+// 0xA8 VOR r<dst>, r<src1>, r<src2>
+static inline
+void vecOr(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+  for (size_t i = 0; i < VEC_BYTES / sizeof(word); ++i) {
+    self->top->r[dst + i].bits = self->top->r[src1 + i].bits | self->top->r[src2 + i].bits;
+  }
+}
+
+// 0xA9 VXOR r<dst>, r<src1>, r<src2>
+static inline
+void vecXor(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src1 = readVarint(&self->ip);
+  size_t src2 = readVarint(&self->ip);
+  for (size_t i = 0; i < VEC_BYTES / sizeof(word); ++i) {
+    self->top->r[dst + i].bits = self->top->r[src1 + i].bits ^ self->top->r[src2 + i].bits;
+  }
+}
+
+// 0xAA VSHUF r<dst>, r<src>, r<idx>
+// Byte shuffle: each lane of dst becomes the lane of src numbered by the low
+// four bits of the same lane in idx, or zero if that lane of idx has its top
+// bit set.
+static inline
+void vecShuffle(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  size_t idx = readVarint(&self->ip);
+#ifdef __SSSE3__
+  VEC_PUT(dst, _mm_shuffle_epi8(VEC_GET(src), VEC_GET(idx)));
+#else
+  Vec from = vecGet(self, src), ix = vecGet(self, idx), out;
+  for (int i = 0; i < VEC_BYTES; ++i) {
+    out.lane[i] = ix.lane[i] & 0x80 ? 0 : from.lane[ix.lane[i] & 0x0F];
+  }
+  vecPut(self, dst, &out);
+#endif
+}
+
+// 0xAB VMSK r<dst>, r<src>
+// Gather the top bit of each lane of src into the low sixteen bits of dst,
+// lane 0 being bit 0. Combined with `VEQ`/`VBL` and `CTZ`/`POPC`, this finds or
+// counts matching bytes.
+static inline
+void vecMoveMask(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+#ifdef __SSE2__
+  self->top->r[dst].bits = (uint16_t)_mm_movemask_epi8(VEC_GET(src));
+#else
+  Vec v = vecGet(self, src);
+  uintptr_t mask = 0;
+  for (int i = 0; i < VEC_BYTES; ++i) { mask |= (uintptr_t)(v.lane[i] >> 7) << i; }
+  self->top->r[dst].bits = mask;
+#endif
+}
+
+// 0xAC VSUM r<dst>, r<src>
+// Horizontal add: store the sum of the (unsigned) lanes of src in dst.
+static inline
+void vecSum(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+#ifdef __SSE2__
+  __m128i sums = _mm_sad_epu8(VEC_GET(src), _mm_setzero_si128());
+  self->top->r[dst].bits = _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+#else
+  Vec v = vecGet(self, src);
+  uintptr_t sum = 0;
+  for (int i = 0; i < VEC_BYTES; ++i) { sum += v.lane[i]; }
+  self->top->r[dst].bits = sum;
+#endif
+}
+
+
+// 0xC0 STRM r<dst>, imm<id>
+// Load a file handle into the destination based on the id: either
+//   standard input (id = 0),
+//   standard outut (id = 1), or
+//   standard error (id = 2).
+// Other values of id store zero in the destination register.
+// A host embedding the machine may substitute its own streams for these.
+static inline
+void strm(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t id = readVarint(&self->ip);
+  self->top->r[dst].fptr = id < 3 ? self->streams[id] : NULL;
+}
+
+// 0xC1 ENV r<dst>, r<src>
+// Lookup the variable name from src in the process' environment.
+// Store pointer to the result in the dst register.
+// Both strings are NUL-terminated.
+// If the environment does not define the given variable, the dst is set to zero.
+
+
+// 0xC2 ARGC r<dst>
+// Load number of arguments (including bytecode filepath) into dst.
+static inline
+void getArgc(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  self->top->r[dst].bits = self->environ.argc;
+}
+
+// 0xC3 ARGV r<dst>, r<ix>
+// Create a handle to a copy of the ix-th argument.
+// The handle is two words: a length and a pointer to a NUL-terminated string of that length.
+// The pointer is global, and so should not be freed/mutated.
+// The handle is written to the contents of the pointer stored in dst.
+static inline
+void getArgv(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t ix = readVarint(&self->ip);
+  char* nulstrp = self->environ.argv[self->top->r[ix].bits];
+  word* tgt = self->top->r[dst].wptr;
+  tgt[0].bits = strlen(nulstrp);
+  tgt[1].bptr = (byte*)nulstrp;
+}
+
+// 0xD0 OPEN imm<mode>, r<dst>, r<src>
+// Opens the file names in src and places the file pointer in dst.
+// The src register should have a pointer to a NUL-terminated string.
+// The mode argument should be:
+//    0 for read,
+//    1 for write (create file if it doesn't exist),
+//    2 for read/write (create file if it doesn't exist).
+// If there is an error, zero is stored in dst.
+static inline
+void openFile(Machine* self) {
+  size_t mode = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  switch (mode) {
+    case 0: {
+      self->top->r[dst].fptr = fopen((char*)self->top->r[src].bptr, "r");
+    } break;
+    case 1: {
+      self->top->r[dst].fptr = fopen((char*)self->top->r[src].bptr, "w");
+    } break;
+    case 2: {
+      FILE* file = fopen((char*)self->top->r[src].bptr, "a+");
+      fseek(file, 0, SEEK_SET);
+      self->top->r[dst].fptr = file;
+    } break;
+    default: {
+      self->top->r[dst].fptr = NULL;
+    }; break;
+  }
+}
+
+// 0xD1 CLOS r<fp>
+// Close a file.
+// This may or may not successfully flush any buffered output.
+static inline
+void closeFile(Machine* self) {
+  size_t fp = readVarint(&self->ip);
+  fclose(self->top->r[fp].fptr);
+}
+
+// 0xD2 GET r<dst>, r<fp>, r<src>
+// Read bytes from the file handle in fp to a buffer pointed to by dst.
+// The src register contains the maximum number of bytes that should be read.
+// At the end of the operation, store the number of bytes actually read in src.
+// If there was an error, store `-read_bytes - 1` in src.
+static inline
+void getBytes(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t fp = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  FILE* file = self->top->r[fp].fptr;
+  size_t req_read = self->top->r[src].bits;
+  size_t real_read = fread(self->top->r[dst].bptr, 1, req_read, file);
+  if (req_read == real_read) {
     self->top->r[src].sbits = real_read;
   }
   else if (feof(file)) {
@@ -1227,3 +2533,173 @@ void seekFile(Machine* self) {
   int res = fseek(self->top->r[fp].fptr, self->top->r[src].sbits, whence);
   self->top->r[src].bits = (res == 0) ? 0 : 1;
 }
+
+// The asynchronous instructions transfer bytes at an explicit offset, like
+// `pread`/`pwrite`: they neither use nor move the file's position, and bypass
+// any output `PUT` has buffered (so `FLUS` first). The buffer must stay valid,
+// and untouched, until the operation's completion has been taken. Each machine
+// has its own queue of at most 64 operations (see aio.h), made on first use.
+
+static inline
+AsyncIo* aioQueue(Machine* self) {
+  if (self->aio == NULL) { self->aio = newAsyncIo(self->aioKind); }
+  return self->aio;
+}
+
+static inline
+void submitAsync(Machine* self, bool write) {
+  size_t err = readVarint(&self->ip);
+  size_t tag = readVarint(&self->ip);
+  size_t fp = readVarint(&self->ip);
+  size_t buf = readVarint(&self->ip);
+  size_t len = readVarint(&self->ip);
+  size_t off = readVarint(&self->ip);
+  AsyncIo* queue = aioQueue(self);
+  bool ok = queue != NULL
+         && aioSubmit(queue, write, self->top->r[fp].fptr, self->top->r[buf].bptr
+                     , self->top->r[len].bits, self->top->r[off].bits, self->top->r[tag].bits);
+  self->top->r[err].bits = ok ? 0 : 1;
+}
+
+// 0xDA AGET r<err>, r<tag>, r<fp>, r<buf>, r<len>, r<off>
+// Start reading up to len bytes from offset off of the file fp into buf,
+// without waiting for them. The completion will carry tag.
+// Store 0 in err if the read started, or 1 if too many operations are already
+// in flight.
+static inline
+void asyncGet(Machine* self) {
+  submitAsync(self, false);
+}
+
+// 0xDB APUT r<err>, r<tag>, r<fp>, r<buf>, r<len>, r<off>
+// Start writing len bytes from buf to offset off of the file fp, without
+// waiting for them. The completion will carry tag.
+// Store 0 in err if the write started, or 1 if too many operations are already
+// in flight.
+static inline
+void asyncPut(Machine* self) {
+  submitAsync(self, true);
+}
+
+static inline
+void completeAsync(Machine* self, bool wait) {
+  size_t ok = readVarint(&self->ip);
+  size_t tag = readVarint(&self->ip);
+  size_t res = readVarint(&self->ip);
+  uintptr_t doneTag;
+  intptr_t doneRes;
+  if (self->aio != NULL && aioComplete(self->aio, wait, &doneTag, &doneRes)) {
+    self->top->r[tag].bits = doneTag;
+    self->top->r[res].sbits = doneRes;
+    self->top->r[ok].bits = 1;
+  }
+  else {
+    self->top->r[ok].bits = 0;
+  }
+}
+
+// 0xDC AWAIT r<ok>, r<tag>, r<res>
+// Wait for an `AGET` or `APUT` to finish, in whatever order they do, and store
+// its tag, and its result in res: the number of bytes transferred, or a
+// negative error number (as `-errno`).
+// Store 1 in ok, or 0 (leaving tag and res alone) if nothing was in flight.
+static inline
+void asyncWait(Machine* self) {
+  completeAsync(self, true);
+}
+
+// 0xDD APOLL r<ok>, r<tag>, r<res>
+// As `AWAIT`, but never wait: if nothing has finished yet, store 0 in ok.
+static inline
+void asyncPoll(Machine* self) {
+  completeAsync(self, false);
+}
+
+// The shared-memory instructions let separate processes (usually other bsvm
+// machines) work on the same bytes; see shm.h. Segment names follow
+// `shm_open`: a NUL-terminated string like "/name". Nothing tracks a mapping
+// once made: it is the program's to `UNSHM`, and the collector never looks
+// inside one, so it must not hold the only pointer to a heap block.
+//
+// Plain loads and stores of shared memory may be seen by other processes late,
+// or out of order; `LDA` and `STA` are not, and are what a protocol between
+// processes should be built from.
+
+// 0xE0 SHM imm<mode>, r<dst>, r<name>, r<size>
+// Map size bytes of the segment called name, and store its address in dst.
+// The mode argument should be:
+//    0 to open an existing segment (which must be at least size bytes), or
+//    1 to create the segment if needed, growing it to size bytes if it is smaller.
+// A newly created segment is zero-filled.
+// If there is an error, zero is stored in dst.
+static inline
+void shmMap(Machine* self) {
+  size_t mode = readVarint(&self->ip);
+  size_t dst = readVarint(&self->ip);
+  size_t name = readVarint(&self->ip);
+  size_t size = readVarint(&self->ip);
+  self->top->r[dst].bptr = mode <= 1
+                         ? mapShared((char*)self->top->r[name].bptr, self->top->r[size].bits, mode == 1)
+                         : NULL;
+}
+
+// 0xE1 UNSHM r<ptr>, r<size>
+// Unmap size bytes at ptr, as mapped by `SHM`.
+static inline
+void shmUnmap(Machine* self) {
+  size_t ptr = readVarint(&self->ip);
+  size_t size = readVarint(&self->ip);
+  unmapShared(self->top->r[ptr].bptr, self->top->r[size].bits);
+}
+
+// 0xE2 SHMRM r<err>, r<name>
+// Remove the segment called name. Existing mappings of it stay valid, but it
+// can no longer be opened.
+// Store 1 in err if there is an error, otherwise store 0 there.
+static inline
+void shmRemove(Machine* self) {
+  size_t err = readVarint(&self->ip);
+  size_t name = readVarint(&self->ip);
+  self->top->r[err].bits = removeShared((char*)self->top->r[name].bptr);
+}
+
+// 0xE3 WAIT r<addr>, r<val>
+// If the word at addr still holds val, sleep until a `WAKE` on addr.
+// Waking may also happen for no reason, so re-check the word afterwards.
+// Only the low 32 bits are compared, so a waker should change the word by
+// less than 2^32 at once.
+static inline
+void futexSleep(Machine* self) {
+  size_t addr = readVarint(&self->ip);
+  size_t val = readVarint(&self->ip);
+  futexWait(self->top->r[addr].wptr, self->top->r[val]);
+}
+
+// 0xE4 WAKE r<addr>, r<n>
+// Wake at most n of the machines waiting on addr, and store how many were in n.
+static inline
+void futexWakeUp(Machine* self) {
+  size_t addr = readVarint(&self->ip);
+  size_t n = readVarint(&self->ip);
+  self->top->r[n].bits = futexWake(self->top->r[addr].wptr, self->top->r[n].bits);
+}
+
+// 0xE5 LDA r<dst>, r<src>
+// Load the word at the address in src into dst, atomically.
+// Atomic loads and stores are sequentially consistent: all processes see them
+// happen in the same order, and no other memory access moves across them.
+static inline
+void loadAtomic(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  self->top->r[dst].bits = __atomic_load_n(&self->top->r[src].wptr->bits, __ATOMIC_SEQ_CST);
+}
+
+// 0xE6 STA r<dst>, r<src>
+// Store the word in src to the address in dst, atomically (see `LDA`).
+static inline
+void storeAtomic(Machine* self) {
+  size_t dst = readVarint(&self->ip);
+  size_t src = readVarint(&self->ip);
+  __atomic_store_n(&self->top->r[dst].wptr->bits, self->top->r[src].bits, __ATOMIC_SEQ_CST);
+}
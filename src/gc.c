@@ -0,0 +1,126 @@
+#include "gc.h"
+
+
+#define MIN_THRESHOLD_BYTES ((size_t)1 << 20)
+
+// A live block, as seen by one collection. The blocks are sorted by address so
+// that the block (if any) a word points into can be found by binary search.
+typedef struct GcBlock GcBlock;
+struct GcBlock {
+  byte* start;
+  byte* end; // one past the last byte
+  bool marked;
+};
+
+typedef struct Marker Marker;
+struct Marker {
+  GcBlock* blocks;
+  size_t len;
+  byte* lo; // no block starts before this
+  byte* hi; // nor ends after this
+  // marked blocks whose contents have not been scanned yet; each block is
+  // pushed at most once, so `len` entries are enough
+  size_t* todo;
+  size_t todo_len;
+};
+
+
+static int compareBlocks(const void* a, const void* b) {
+  uintptr_t x = (uintptr_t)((const GcBlock*)a)->start;
+  uintptr_t y = (uintptr_t)((const GcBlock*)b)->start;
+  return (x > y) - (x < y);
+}
+
+static void markWord(Marker* self, word w) {
+  byte* ptr = w.bptr;
+  if (ptr < self->lo || self->hi < ptr) { return; }
+  // find the last block starting at or before ptr
+  size_t lo = 0, hi = self->len;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (self->blocks[mid].start <= ptr) { lo = mid; }
+    else { hi = mid; }
+  }
+  GcBlock* block = &self->blocks[lo];
+  if (ptr < block->start || block->end < ptr || block->marked) { return; }
+  block->marked = true;
+  self->todo[self->todo_len++] = lo;
+}
+
+static void markRange(Marker* self, const word* at, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    markWord(self, at[i]);
+  }
+}
+
+
+void enableGc(Heap* heap) {
+  heap->gc.enabled = true;
+  heap->gc.allocated_bytes = 0;
+  heap->gc.threshold_bytes = MIN_THRESHOLD_BYTES;
+}
+
+void collectGarbage(Machine* machine) {
+  Heap* heap = &machine->heap;
+  heap->gc.allocated_bytes = 0;
+  Marker marker = { .blocks = NULL, .len = 0, .lo = NULL, .hi = NULL, .todo = NULL, .todo_len = 0 };
+  for (void* ptr = heapNext(heap, NULL); ptr != NULL; ptr = heapNext(heap, ptr)) {
+    marker.len += 1;
+  }
+  if (marker.len == 0) { return; }
+  marker.blocks = malloc(sizeof(GcBlock) * marker.len);
+  marker.todo = malloc(sizeof(size_t) * marker.len);
+  if (marker.blocks == NULL || marker.todo == NULL) {
+    // try again once the program has allocated as much again
+    free(marker.blocks);
+    free(marker.todo);
+    return;
+  }
+  // gather the blocks
+  {
+    size_t i = 0;
+    for (void* ptr = heapNext(heap, NULL); ptr != NULL; ptr = heapNext(heap, ptr), ++i) {
+      marker.blocks[i].start = ptr;
+      marker.blocks[i].end = (byte*)ptr + heapBlockSize(heap, ptr);
+      marker.blocks[i].marked = false;
+    }
+    qsort(marker.blocks, marker.len, sizeof(GcBlock), compareBlocks);
+    marker.lo = marker.blocks[0].start;
+    marker.hi = marker.blocks[0].end;
+    for (i = 1; i < marker.len; ++i) {
+      if (marker.blocks[i].end > marker.hi) { marker.hi = marker.blocks[i].end; }
+    }
+  }
+  // mark from the roots
+  for (StackFrame* frame = machine->top; frame != NULL; frame = frame->prev) {
+    markRange(&marker, frame->r, frame->size_words);
+  }
+  markRange(&marker, machine->global.at, machine->global.len);
+  markRange(&marker, machine->retarray.bufp, machine->retarray.cap);
+  if (machine->aio != NULL) {
+    word inflight[2 * AIO_DEPTH];
+    markRange(&marker, inflight, aioInflight(machine->aio, inflight));
+  }
+  // then through whatever they reach
+  while (marker.todo_len != 0) {
+    GcBlock* block = &marker.blocks[marker.todo[--marker.todo_len]];
+    markRange(&marker, (const word*)block->start, (block->end - block->start) / sizeof(word));
+  }
+  // sweep
+  size_t survived_bytes = 0;
+  for (size_t i = 0; i < marker.len; ++i) {
+    size_t size_bytes = marker.blocks[i].end - marker.blocks[i].start;
+    if (marker.blocks[i].marked) {
+      survived_bytes += size_bytes;
+    }
+    else {
+      heapFree(heap, marker.blocks[i].start);
+      heap->gc.freed_blocks += 1;
+      heap->gc.freed_bytes += size_bytes;
+    }
+  }
+  heap->gc.collections += 1;
+  heap->gc.threshold_bytes = survived_bytes > MIN_THRESHOLD_BYTES ? survived_bytes : MIN_THRESHOLD_BYTES;
+  free(marker.blocks);
+  free(marker.todo);
+}
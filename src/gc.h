@@ -0,0 +1,44 @@
+#ifndef GC_H
+#define GC_H
+
+#include "types.h"
+
+
+// An optional conservative mark-sweep collector for the machine's heap.
+//
+// The roots are every register of every frame, the globals, the return value
+// buffer, and the buffer and tag of every `AGET`/`APUT` still in flight, since
+// the program may hold them nowhere else until `AWAIT`. (The program's
+// read-only data is not a root: it is protected once loaded, so nothing can
+// store a pointer there.) Any word-aligned word there, or in a block already found to
+// be reachable, that points into a live block (anywhere from its start to one
+// past its end) keeps that block alive. Everything else is freed. Since nothing
+// can tell an integer from a pointer, an integer that happens to look like one
+// only keeps a block alive a little longer; a pointer stored at an unaligned
+// offset, or hidden from the machine some other way (say, by the host), is not
+// seen at all.
+//
+// `FREE` is still allowed, and still the cheapest way to give memory back.
+//
+// Only a tracked heap (see heap.h) can be collected.
+
+// Start collecting a tracked heap. The first collection comes once a
+// megabyte has been allocated; after that, once as much again has been
+// allocated as survived the last one (but still at least a megabyte).
+void enableGc(Heap* heap);
+
+// Free every block that is unreachable from the roots.
+void collectGarbage(Machine* machine);
+
+// Collect garbage if enough has been allocated since the last collection.
+// Only call this between instructions, when every pointer the program holds
+// is in one of the roots.
+static inline void maybeCollectGarbage(Machine* machine) {
+  if (machine->heap.gc.enabled
+      && machine->heap.gc.allocated_bytes >= machine->heap.gc.threshold_bytes) {
+    collectGarbage(machine);
+  }
+}
+
+
+#endif
@@ -0,0 +1,328 @@
+#include "heap.h"
+
+
+// Every block handed out by a pool (or a heap keeping statistics) is preceded
+// by this header, padded so that the block itself stays as aligned as malloc's.
+// Only tracked heaps have room for the links, which thread all live blocks
+// into a list.
+struct BlockInfo {
+  size_t size_bytes; // as requested
+  uintptr_t site;
+  BlockInfo* prev;
+  BlockInfo* next;
+};
+#define GRANULE _Alignof(max_align_t)
+#define ROUND_UP(n) (((n) + GRANULE - 1) & ~(GRANULE - 1))
+#define SMALL_HEADER_BYTES ROUND_UP(offsetof(BlockInfo, prev))
+#define TRACKED_HEADER_BYTES ROUND_UP(sizeof(BlockInfo))
+
+// Small blocks come in classes that are multiples of the granule (header
+// included). Anything bigger goes to malloc.
+#define NUM_CLASSES HEAP_POOL_CLASSES
+#define MAX_POOLED_BYTES (NUM_CLASSES * GRANULE)
+#define SLAB_BYTES 16384
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+struct Slab {
+  Slab* prev;
+  _Alignas(max_align_t) byte data[];
+};
+
+
+static inline size_t blockBytes(const Heap* self, size_t size_bytes) {
+  return self->header_bytes + ROUND_UP(size_bytes);
+}
+
+static inline BlockInfo* infoOf(const Heap* self, const void* ptr) {
+  return (BlockInfo*)((byte*)ptr - self->header_bytes);
+}
+
+// A pool belongs to its heap, and so to one machine, so no locking is needed.
+static bool refill(Heap* self, size_t class) {
+  size_t block_bytes = (class + 1) * GRANULE;
+  Slab* slab = malloc(sizeof(Slab) + SLAB_BYTES);
+  if (slab == NULL) { return false; }
+  slab->prev = self->pool.slabs;
+  self->pool.slabs = slab;
+  FreeBlock* list = self->pool.free[class];
+  for (size_t off = 0; off + block_bytes <= SLAB_BYTES; off += block_bytes) {
+    FreeBlock* block = (FreeBlock*)(slab->data + off);
+    block->next = list;
+    list = block;
+  }
+  self->pool.free[class] = list;
+  return true;
+}
+
+static BlockInfo* poolTake(Heap* self, size_t block_bytes) {
+  if (block_bytes > MAX_POOLED_BYTES) {
+    return malloc(block_bytes);
+  }
+  size_t class = block_bytes / GRANULE - 1;
+  if (self->pool.free[class] == NULL && !refill(self, class)) { return NULL; }
+  FreeBlock* block = self->pool.free[class];
+  self->pool.free[class] = block->next;
+  return (BlockInfo*)block;
+}
+
+static void poolGive(Heap* self, BlockInfo* info) {
+  size_t block_bytes = blockBytes(self, info->size_bytes);
+  if (block_bytes > MAX_POOLED_BYTES) {
+    free(info);
+    return;
+  }
+  size_t class = block_bytes / GRANULE - 1;
+  FreeBlock* block = (FreeBlock*)info;
+  block->next = self->pool.free[class];
+  self->pool.free[class] = block;
+}
+
+
+////// Statistics //////
+
+static inline size_t hashSite(uintptr_t site) {
+  // Fibonacci hashing; the table size is a power of two
+  return (size_t)(site * (uintptr_t)0x9E3779B97F4A7C15ull);
+}
+
+static HeapSite* findSite(Heap* self, uintptr_t site) {
+  if (2 * (self->sites.len + 1) > self->sites.cap) {
+    size_t oldCap = self->sites.cap;
+    HeapSite* old = self->sites.at;
+    size_t cap = oldCap == 0 ? 64 : 2 * oldCap;
+    HeapSite* at = calloc(cap, sizeof(HeapSite));
+    if (at == NULL) { return NULL; }
+    for (size_t i = 0; i < oldCap; ++i) {
+      if (old[i].site == 0) { continue; }
+      size_t j = hashSite(old[i].site) & (cap - 1);
+      while (at[j].site != 0) { j = (j + 1) & (cap - 1); }
+      at[j] = old[i];
+    }
+    free(old);
+    self->sites.cap = cap;
+    self->sites.at = at;
+  }
+  size_t mask = self->sites.cap - 1;
+  size_t i = hashSite(site + 1) & mask;
+  while (self->sites.at[i].site != 0) {
+    if (self->sites.at[i].site == site + 1) { return &self->sites.at[i]; }
+    i = (i + 1) & mask;
+  }
+  self->sites.len += 1;
+  self->sites.at[i].site = site + 1;
+  return &self->sites.at[i];
+}
+
+static void countAlloc(Heap* self, BlockInfo* info) {
+  self->allocs += 1;
+  self->live_bytes += info->size_bytes;
+  if (self->live_bytes > self->peak_bytes) { self->peak_bytes = self->live_bytes; }
+  HeapSite* site = findSite(self, info->site);
+  if (site == NULL) { return; }
+  site->allocs += 1;
+  site->live_blocks += 1;
+  site->live_bytes += info->size_bytes;
+}
+
+static void countFree(Heap* self, BlockInfo* info) {
+  self->frees += 1;
+  self->live_bytes -= info->size_bytes;
+  HeapSite* site = findSite(self, info->site);
+  if (site == NULL) { return; }
+  site->live_blocks -= 1;
+  site->live_bytes -= info->size_bytes;
+}
+
+
+////// Tracking //////
+
+static void link(Heap* self, BlockInfo* info) {
+  info->prev = NULL;
+  info->next = self->live;
+  if (self->live != NULL) { self->live->prev = info; }
+  self->live = info;
+}
+
+static void unlink(Heap* self, BlockInfo* info) {
+  if (info->prev != NULL) { info->prev->next = info->next; }
+  else { self->live = info->next; }
+  if (info->next != NULL) { info->next->prev = info->prev; }
+}
+
+
+////// Interface //////
+
+void initHeap(Heap* out, HeapKind kind, bool stats, bool tracked) {
+  out->kind = kind;
+  out->stats = stats;
+  out->tracked = tracked;
+  if (tracked) { out->header_bytes = TRACKED_HEADER_BYTES; }
+  else if (kind != HEAP_LIBC || stats) { out->header_bytes = SMALL_HEADER_BYTES; }
+  else { out->header_bytes = 0; }
+  out->live = NULL;
+  for (size_t i = 0; i < NUM_CLASSES; ++i) { out->pool.free[i] = NULL; }
+  out->pool.slabs = NULL;
+  out->allocs = 0;
+  out->frees = 0;
+  out->live_bytes = 0;
+  out->peak_bytes = 0;
+  out->sites.cap = 0;
+  out->sites.len = 0;
+  out->sites.at = NULL;
+  out->gc.enabled = false;
+  out->gc.allocated_bytes = 0;
+  out->gc.threshold_bytes = 0;
+  out->gc.collections = 0;
+  out->gc.freed_blocks = 0;
+  out->gc.freed_bytes = 0;
+}
+
+// Releases the bookkeeping, and a pool's slabs along with every small block
+// still live in them. Other blocks still live are left alone.
+void destroyHeap(Heap* self) {
+  while (self->pool.slabs != NULL) {
+    Slab* prev = self->pool.slabs->prev;
+    free(self->pool.slabs);
+    self->pool.slabs = prev;
+  }
+  for (size_t i = 0; i < NUM_CLASSES; ++i) { self->pool.free[i] = NULL; }
+  free(self->sites.at);
+  self->sites.at = NULL;
+  self->sites.cap = 0;
+  self->sites.len = 0;
+}
+
+// Allocate a block, recording `site` (a code offset) as its origin.
+// Returns NULL when out of memory.
+void* heapAlloc(Heap* self, size_t size_bytes, uintptr_t site) {
+  if (self->header_bytes == 0) {
+    return malloc(size_bytes);
+  }
+  size_t block_bytes = blockBytes(self, size_bytes);
+  if (block_bytes < size_bytes) { return NULL; } // overflow
+  BlockInfo* info = self->kind == HEAP_POOL ? poolTake(self, block_bytes) : malloc(block_bytes);
+  if (info == NULL) { return NULL; }
+  info->size_bytes = size_bytes;
+  info->site = site;
+  if (self->tracked) { link(self, info); }
+  if (self->stats) { countAlloc(self, info); }
+  self->gc.allocated_bytes += size_bytes;
+  return (byte*)info + self->header_bytes;
+}
+
+// Free a block from `heapAlloc`/`heapRealloc`. Freeing NULL does nothing.
+void heapFree(Heap* self, void* ptr) {
+  if (ptr == NULL) { return; }
+  if (self->header_bytes == 0) {
+    free(ptr);
+    return;
+  }
+  BlockInfo* info = infoOf(self, ptr);
+  if (self->stats) { countFree(self, info); }
+  if (self->tracked) { unlink(self, info); }
+  if (self->kind == HEAP_POOL) { poolGive(self, info); }
+  else { free(info); }
+}
+
+// As C `realloc`: the old block is left alone if the new one can't be had.
+// For statistics, a resize counts as freeing the old block and allocating a
+// new one at `site`.
+void* heapRealloc(Heap* self, void* ptr, size_t size_bytes, uintptr_t site) {
+  if (ptr == NULL) { return heapAlloc(self, size_bytes, site); }
+  if (self->header_bytes == 0) {
+    return realloc(ptr, size_bytes);
+  }
+  BlockInfo* info = infoOf(self, ptr);
+  size_t block_bytes = blockBytes(self, size_bytes);
+  if (block_bytes < size_bytes) { return NULL; } // overflow
+  BlockInfo old = *info;
+  BlockInfo* new;
+  if (self->kind == HEAP_POOL) {
+    if (block_bytes <= MAX_POOLED_BYTES && block_bytes == blockBytes(self, info->size_bytes)) {
+      // still the right size class, so stay put
+      new = info;
+    }
+    else {
+      new = poolTake(self, block_bytes);
+      if (new == NULL) { return NULL; }
+      size_t keep = size_bytes < info->size_bytes ? size_bytes : info->size_bytes;
+      memcpy((byte*)new + self->header_bytes, ptr, keep);
+      if (self->tracked) { unlink(self, info); }
+      poolGive(self, info);
+      if (self->tracked) { link(self, new); }
+    }
+  }
+  else {
+    // the links of the neighbors must not point at a block that moved
+    if (self->tracked) { unlink(self, info); }
+    new = realloc(info, block_bytes);
+    if (new == NULL) {
+      if (self->tracked) { link(self, info); }
+      return NULL;
+    }
+    if (self->tracked) { link(self, new); }
+  }
+  if (self->stats) { countFree(self, &old); }
+  new->size_bytes = size_bytes;
+  new->site = site;
+  if (self->stats) { countAlloc(self, new); }
+  self->gc.allocated_bytes += size_bytes;
+  return (byte*)new + self->header_bytes;
+}
+
+// Free every live block of a tracked heap.
+void heapFreeAll(Heap* self) {
+  while (self->live != NULL) {
+    heapFree(self, (byte*)self->live + self->header_bytes);
+  }
+}
+
+// Iterate over the live blocks of a tracked heap, most recent first.
+// Start with `heapNext(self, NULL)`; NULL marks the end.
+void* heapNext(const Heap* self, const void* ptr) {
+  BlockInfo* info = ptr == NULL ? self->live : infoOf(self, ptr)->next;
+  return info == NULL ? NULL : (byte*)info + self->header_bytes;
+}
+
+// Size and allocation site of a block from a heap with headers.
+size_t heapBlockSize(const Heap* self, const void* ptr) {
+  return infoOf(self, ptr)->size_bytes;
+}
+uintptr_t heapBlockSite(const Heap* self, const void* ptr) {
+  return infoOf(self, ptr)->site;
+}
+
+
+static int compareSites(const void* a, const void* b) {
+  uintptr_t x = ((const HeapSite*)a)->site;
+  uintptr_t y = ((const HeapSite*)b)->site;
+  return (x > y) - (x < y);
+}
+
+// Report counts, live and peak bytes, and any blocks still live, grouped by
+// the code offset of the instruction that allocated them.
+void fputHeapStats(FILE* fp, const Heap* self) {
+  fprintf(fp, "[HEAP] %zu allocs, %zu frees, %zu bytes live, %zu bytes peak\n"
+         , self->allocs, self->frees, self->live_bytes, self->peak_bytes);
+  HeapSite* leaks = malloc(sizeof(HeapSite) * (self->sites.len + 1));
+  if (leaks == NULL) { return; }
+  size_t n = 0;
+  for (size_t i = 0; i < self->sites.cap; ++i) {
+    if (self->sites.at[i].site != 0 && self->sites.at[i].live_blocks != 0) {
+      leaks[n++] = self->sites.at[i];
+    }
+  }
+  qsort(leaks, n, sizeof(HeapSite), compareSites);
+  for (size_t i = 0; i < n; ++i) {
+    fprintf(fp, "[HEAP] leak: %zu blocks (%zu bytes) from %08lx (%zu allocs)\n"
+           , leaks[i].live_blocks, leaks[i].live_bytes
+           , (unsigned long)(leaks[i].site - 1), leaks[i].allocs);
+  }
+  free(leaks);
+  if (self->gc.enabled) {
+    fprintf(fp, "[HEAP] %zu collections freed %zu blocks (%zu bytes)\n"
+           , self->gc.collections, self->gc.freed_blocks, self->gc.freed_bytes);
+  }
+}
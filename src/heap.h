@@ -0,0 +1,79 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "common.h"
+
+
+// Where the memory for `NEW`/`FREE`/`RNEW` comes from.
+typedef enum HeapKind {
+  HEAP_LIBC, // straight through to malloc/free/realloc
+  HEAP_POOL, // the heap's own size-class free lists; large blocks go to malloc
+} HeapKind;
+
+// Allocation statistics for one allocating instruction.
+typedef struct HeapSite HeapSite;
+struct HeapSite {
+  uintptr_t site; // code offset of the instruction, plus one so that zero marks an empty slot
+  size_t allocs;
+  size_t live_blocks;
+  size_t live_bytes;
+};
+
+typedef struct BlockInfo BlockInfo;
+typedef struct FreeBlock FreeBlock;
+typedef struct Slab Slab;
+
+// Small blocks of a pool come in this many size classes (see heap.c).
+#define HEAP_POOL_CLASSES 16
+
+typedef struct Heap Heap;
+struct Heap {
+  HeapKind kind;
+  bool stats;
+  // A tracked heap can enumerate its live blocks (e.g. for snapshots).
+  bool tracked;
+  // Blocks carry a small header (size and allocation site) unless this is a
+  // plain libc heap that keeps no statistics and does no tracking.
+  size_t header_bytes;
+  BlockInfo* live; // only on tracked heaps
+  // Only pools use these. The slabs are carved into blocks, and are only given
+  // back to malloc by `destroyHeap`.
+  struct {
+    FreeBlock* free[HEAP_POOL_CLASSES];
+    Slab* slabs;
+  } pool;
+  size_t allocs;
+  size_t frees;
+  size_t live_bytes;
+  size_t peak_bytes;
+  struct {
+    size_t cap; // always a power of two (or zero)
+    size_t len;
+    HeapSite* at;
+  } sites;
+  // Garbage collection (see gc.h) needs a tracked heap.
+  struct {
+    bool enabled;
+    size_t allocated_bytes; // since the last collection
+    size_t threshold_bytes; // how much to allocate before collecting again
+    size_t collections;
+    size_t freed_blocks;
+    size_t freed_bytes;
+  } gc;
+};
+void initHeap(Heap* out, HeapKind kind, bool stats, bool tracked);
+void destroyHeap(Heap* self);
+
+void* heapAlloc(Heap* self, size_t size_bytes, uintptr_t site);
+void heapFree(Heap* self, void* ptr);
+void* heapRealloc(Heap* self, void* ptr, size_t size_bytes, uintptr_t site);
+
+void heapFreeAll(Heap* self);
+void* heapNext(const Heap* self, const void* ptr);
+size_t heapBlockSize(const Heap* self, const void* ptr);
+uintptr_t heapBlockSite(const Heap* self, const void* ptr);
+
+void fputHeapStats(FILE* fp, const Heap* self);
+
+
+#endif
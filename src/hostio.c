@@ -0,0 +1,50 @@
+#define _GNU_SOURCE // for `fopencookie`
+
+#include "hostio.h"
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+
+typedef struct HostStream HostStream;
+struct HostStream {
+  void* ctx;
+  HostReadFn read;
+  HostWriteFn write;
+};
+
+static ssize_t hostRead(void* cookie, char* buf, size_t len) {
+  HostStream* self = cookie;
+  if (self->read == NULL) { return -1; }
+  return self->read(self->ctx, buf, len);
+}
+
+static ssize_t hostWrite(void* cookie, const char* buf, size_t len) {
+  HostStream* self = cookie;
+  if (self->write == NULL) { return 0; }
+  return self->write(self->ctx, buf, len);
+}
+
+static int hostClose(void* cookie) {
+  free(cookie);
+  return 0;
+}
+
+// Returns NULL when out of memory.
+FILE* openHostStream(void* ctx, HostReadFn read, HostWriteFn write) {
+  HostStream* self = malloc(sizeof(HostStream));
+  if (self == NULL) { return NULL; }
+  self->ctx = ctx;
+  self->read = read;
+  self->write = write;
+  cookie_io_functions_t io = {
+    .read = hostRead,
+    .write = hostWrite,
+    .seek = NULL,
+    .close = hostClose,
+  };
+  const char* mode = read != NULL && write != NULL ? "r+" : read != NULL ? "r" : "w";
+  FILE* fp = fopencookie(self, mode, io);
+  if (fp == NULL) { free(self); }
+  return fp;
+}
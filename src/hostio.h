@@ -0,0 +1,21 @@
+#ifndef HOSTIO_H
+#define HOSTIO_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+
+// Host-provided I/O callbacks, dressed up as a `FILE*` so that the machine's
+// I/O instructions need not know the difference.
+//
+// Each callback transfers up to `len` bytes and returns how many it managed;
+// zero means end-of-file (for reads) or an error (for writes). Either callback
+// may be NULL, in which case the stream cannot be used in that direction.
+// Closing the stream does not affect `ctx`.
+typedef size_t (*HostReadFn)(void* ctx, char* buf, size_t len);
+typedef size_t (*HostWriteFn)(void* ctx, const char* buf, size_t len);
+
+FILE* openHostStream(void* ctx, HostReadFn read, HostWriteFn write);
+
+
+#endif
@@ -0,0 +1,372 @@
+#include "iolog.h"
+
+#include "execute.h"
+
+
+int openIoLogRecord(IoLog* out, const char* filename) {
+  out->replaying = false;
+  out->failed = false;
+  out->in.at = NULL;
+  out->in.len = 0;
+  out->in.next = 0;
+  out->handles = 0;
+  out->output.bytes = 0;
+  out->output.hash = 0;
+  out->out = fopen(filename, "wb");
+  if (out->out == NULL) { return -1; }
+  if (fwrite("BsvmIoL1", 1, 8, out->out) != 8) {
+    fclose(out->out);
+    return -1;
+  }
+  return 0;
+}
+
+int openIoLogReplay(IoLog* out, const char* filename) {
+  out->replaying = true;
+  out->failed = false;
+  out->out = NULL;
+  out->handles = 0;
+  out->output.bytes = 0;
+  out->output.hash = 0xCBF29CE484222325ull;
+  FILE* fp = fopen(filename, "rb");
+  if (fp == NULL) { return -1; }
+  size_t cap = 4096, len = 0;
+  byte* at = malloc(cap);
+  while (at != NULL) {
+    len += fread(at + len, 1, cap - len, fp);
+    if (len < cap) { break; }
+    byte* grown = realloc(at, 2 * cap);
+    if (grown == NULL) { free(at); }
+    at = grown;
+    cap *= 2;
+  }
+  bool ok = at != NULL && !ferror(fp) && len >= 8 && memcmp(at, "BsvmIoL1", 8) == 0;
+  fclose(fp);
+  if (!ok) {
+    free(at);
+    return -1;
+  }
+  out->in.at = at;
+  out->in.len = len;
+  out->in.next = 8;
+  return 0;
+}
+
+int closeIoLog(IoLog* self) {
+  if (self->out != NULL) {
+    if (fclose(self->out) == EOF) { self->failed = true; }
+    self->out = NULL;
+  }
+  free(self->in.at);
+  self->in.at = NULL;
+  return self->failed ? -1 : 0;
+}
+
+
+////// Recording //////
+
+// Each recording handler runs the normal one, then decodes the operands again
+// (from `args`, just past the opcode) to see what it did. Anything the
+// instruction itself might overwrite, like where `ARGV` writes its handle, is
+// read before it runs.
+
+static void putU(IoLog* self, uintptr_t n) {
+  do {
+    byte b = n & 0x7F;
+    n >>= 7;
+    if (putc(n != 0 ? b | 0x80 : b, self->out) == EOF) { self->failed = true; }
+  } while (n != 0);
+}
+static void putS(IoLog* self, intptr_t n) {
+  putU(self, ((uintptr_t)n << 1) ^ (uintptr_t)(n < 0 ? -1 : 0));
+}
+static void putRaw(IoLog* self, const byte* at, size_t len) {
+  if (fwrite(at, 1, len, self->out) != len) { self->failed = true; }
+}
+
+static byte* recordOpcode(Machine* self) {
+  byte* args = self->ip;
+  putU(self->iolog, *(args - 1));
+  normalDispatch[*(args - 1)](self);
+  return args;
+}
+
+static void recordStrm(Machine* self) {
+  recordOpcode(self);
+}
+
+static void recordArgc(Machine* self) {
+  byte* args = recordOpcode(self);
+  size_t dst = readVarint(&args);
+  putU(self->iolog, self->top->r[dst].bits);
+}
+
+static void recordArgv(Machine* self) {
+  byte* args = self->ip;
+  size_t dst = readVarint(&args);
+  word* tgt = self->top->r[dst].wptr;
+  recordOpcode(self);
+  putU(self->iolog, tgt[0].bits);
+  putRaw(self->iolog, tgt[1].bptr, tgt[0].bits + 1);
+}
+
+static void recordOpen(Machine* self) {
+  byte* args = recordOpcode(self);
+  readVarint(&args); // mode
+  size_t dst = readVarint(&args);
+  putU(self->iolog, self->top->r[dst].fptr != NULL);
+}
+
+static void recordGet(Machine* self) {
+  byte* args = self->ip;
+  size_t dst = readVarint(&args);
+  readVarint(&args); // fp
+  size_t src = readVarint(&args);
+  byte* buf = self->top->r[dst].bptr;
+  recordOpcode(self);
+  intptr_t res = self->top->r[src].sbits;
+  putS(self->iolog, res);
+  putRaw(self->iolog, buf, res >= 0 ? res : -res - 1);
+}
+
+// GETB, TELL and SEEK each store one number, at different operands.
+static void recordGetb(Machine* self) {
+  byte* args = recordOpcode(self);
+  size_t dst = readVarint(&args);
+  putS(self->iolog, self->top->r[dst].sbits);
+}
+
+static void recordTell(Machine* self) {
+  byte* args = recordOpcode(self);
+  readVarint(&args); // fp
+  size_t dst = readVarint(&args);
+  putS(self->iolog, self->top->r[dst].sbits);
+}
+
+static void recordSeek(Machine* self) {
+  byte* args = recordOpcode(self);
+  readVarint(&args); // whence
+  readVarint(&args); // fp
+  size_t src = readVarint(&args);
+  putS(self->iolog, self->top->r[src].sbits);
+}
+
+
+////// Replaying //////
+
+// Halt the machine, which asked for something other than what the log holds.
+static void diverge(Machine* self) {
+  self->iolog->failed = true;
+  fprintf(stderr, "[ERROR] replay diverged from the log at %08lx\n"
+         , (unsigned long)(self->ip - self->program->code));
+  self->shouldHalt = true;
+  self->exitcode = -1;
+}
+
+static bool takeU(IoLog* self, uintptr_t* out) {
+  uintptr_t n = 0;
+  for (unsigned shift = 0; self->in.next < self->in.len && shift < 8 * sizeof(n); shift += 7) {
+    byte b = self->in.at[self->in.next++];
+    n |= (uintptr_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *out = n;
+      return true;
+    }
+  }
+  return false;
+}
+static bool takeS(IoLog* self, intptr_t* out) {
+  uintptr_t n;
+  if (!takeU(self, &n)) { return false; }
+  *out = (intptr_t)(n >> 1) ^ -(intptr_t)(n & 1);
+  return true;
+}
+static const byte* takeRaw(IoLog* self, size_t len) {
+  if (self->in.len - self->in.next < len) { return NULL; }
+  const byte* out = self->in.at + self->in.next;
+  self->in.next += len;
+  return out;
+}
+
+// Begin replaying an instruction, with `ip` still just past the opcode. The
+// instruction is left undone (and the machine halted) if it is not the next
+// one in the log.
+static bool takeOpcode(Machine* self) {
+  uintptr_t opcode;
+  if (takeU(self->iolog, &opcode) && opcode == *(self->ip - 1)) { return true; }
+  self->ip -= 1;
+  diverge(self);
+  return false;
+}
+
+// Stand-ins for file handles, which are never dereferenced.
+static FILE* fakeHandle(uintptr_t n) {
+  return (FILE*)(uintptr_t)(sizeof(word) * (n + 1));
+}
+
+static void replayStrm(Machine* self) {
+  if (!takeOpcode(self)) { return; }
+  size_t dst = readVarint(&self->ip);
+  size_t id = readVarint(&self->ip);
+  self->top->r[dst].fptr = id < 3 ? fakeHandle(id) : NULL;
+}
+
+static void replayArgc(Machine* self) {
+  byte* here = self->ip - 1;
+  if (!takeOpcode(self)) { return; }
+  size_t dst = readVarint(&self->ip);
+  if (!takeU(self->iolog, &self->top->r[dst].bits)) { self->ip = here; diverge(self); }
+}
+
+static void replayArgv(Machine* self) {
+  byte* here = self->ip - 1;
+  if (!takeOpcode(self)) { return; }
+  size_t dst = readVarint(&self->ip);
+  readVarint(&self->ip); // ix
+  uintptr_t len;
+  const byte* str;
+  if (!takeU(self->iolog, &len) || (str = takeRaw(self->iolog, len + 1)) == NULL) {
+    self->ip = here;
+    diverge(self);
+    return;
+  }
+  word* tgt = self->top->r[dst].wptr;
+  tgt[0].bits = len;
+  tgt[1].bptr = (byte*)str;
+}
+
+static void replayOpen(Machine* self) {
+  byte* here = self->ip - 1;
+  if (!takeOpcode(self)) { return; }
+  readVarint(&self->ip); // mode
+  size_t dst = readVarint(&self->ip);
+  readVarint(&self->ip); // src
+  uintptr_t ok;
+  if (!takeU(self->iolog, &ok)) { self->ip = here; diverge(self); return; }
+  self->top->r[dst].fptr = ok ? fakeHandle(3 + self->iolog->handles++) : NULL;
+}
+
+static void replayGet(Machine* self) {
+  byte* here = self->ip - 1;
+  if (!takeOpcode(self)) { return; }
+  size_t dst = readVarint(&self->ip);
+  readVarint(&self->ip); // fp
+  size_t src = readVarint(&self->ip);
+  intptr_t res;
+  const byte* bytes;
+  if (!takeS(self->iolog, &res)) { self->ip = here; diverge(self); return; }
+  size_t len = res >= 0 ? res : -res - 1;
+  if (len > self->top->r[src].bits || (bytes = takeRaw(self->iolog, len)) == NULL) {
+    self->ip = here;
+    diverge(self);
+    return;
+  }
+  memcpy(self->top->r[dst].bptr, bytes, len);
+  self->top->r[src].sbits = res;
+}
+
+static void replayGetb(Machine* self) {
+  byte* here = self->ip - 1;
+  if (!takeOpcode(self)) { return; }
+  size_t dst = readVarint(&self->ip);
+  readVarint(&self->ip); // fp
+  if (!takeS(self->iolog, &self->top->r[dst].sbits)) { self->ip = here; diverge(self); }
+}
+
+static void replayTell(Machine* self) {
+  byte* here = self->ip - 1;
+  if (!takeOpcode(self)) { return; }
+  readVarint(&self->ip); // fp
+  size_t dst = readVarint(&self->ip);
+  if (!takeS(self->iolog, &self->top->r[dst].sbits)) { self->ip = here; diverge(self); }
+}
+
+static void replaySeek(Machine* self) {
+  byte* here = self->ip - 1;
+  if (!takeOpcode(self)) { return; }
+  readVarint(&self->ip); // whence
+  readVarint(&self->ip); // fp
+  size_t src = readVarint(&self->ip);
+  if (!takeS(self->iolog, &self->top->r[src].sbits)) { self->ip = here; diverge(self); }
+}
+
+// Output is only counted and hashed, and always succeeds.
+static void hashOutput(IoLog* self, const byte* at, size_t len) {
+  uint64_t hash = self->output.hash;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ at[i]) * 0x100000001B3ull;
+  }
+  self->output.hash = hash;
+  self->output.bytes += len;
+}
+
+static void replayPut(Machine* self) {
+  readVarint(&self->ip); // fp
+  size_t src = readVarint(&self->ip);
+  word* str = self->top->r[src].wptr;
+  hashOutput(self->iolog, str[1].bptr, str[0].bits);
+  self->top->r[src].sbits = str[0].bits;
+}
+
+static void replayPutb(Machine* self) {
+  readVarint(&self->ip); // fp
+  size_t src = readVarint(&self->ip);
+  hashOutput(self->iolog, &self->top->r[src].byte.low, 1);
+}
+
+static void replayFlush(Machine* self) {
+  readVarint(&self->ip); // fp
+  size_t err = readVarint(&self->ip);
+  self->top->r[err].bits = 0;
+}
+
+static void replayClose(Machine* self) {
+  readVarint(&self->ip); // fp
+}
+
+
+// Asynchronous I/O completes in no fixed order, and other processes change
+// shared memory whenever they like, so neither can be logged.
+static void refuseUnloggable(Machine* self) {
+  const char* what = self->ip[-1] == 0xE0 ? "shared memory" : "asynchronous I/O";
+  fprintf(stderr, "[ERROR] %s cannot be recorded or replayed (at %08lx)\n"
+         , what, (unsigned long)(self->ip - 1 - self->program->code));
+  self->ip -= 1;
+  self->shouldHalt = true;
+  self->exitcode = -1;
+}
+
+
+void attachIoLog(Machine* machine, IoLog* self) {
+  memcpy(self->dispatch, normalDispatch, sizeof(self->dispatch));
+  for (int opcode = 0xDA; opcode <= 0xDD; ++opcode) {
+    self->dispatch[opcode] = refuseUnloggable;
+  }
+  self->dispatch[0xE0] = refuseUnloggable;
+  if (self->replaying) {
+    self->dispatch[0xC0] = replayStrm;
+    self->dispatch[0xC2] = replayArgc;
+    self->dispatch[0xC3] = replayArgv;
+    self->dispatch[0xD0] = replayOpen;
+    self->dispatch[0xD1] = replayClose;
+    self->dispatch[0xD2] = replayGet;
+    self->dispatch[0xD3] = replayPut;
+    self->dispatch[0xD4] = replayGetb;
+    self->dispatch[0xD5] = replayPutb;
+    self->dispatch[0xD7] = replayFlush;
+    self->dispatch[0xD8] = replayTell;
+    self->dispatch[0xD9] = replaySeek;
+  }
+  else {
+    self->dispatch[0xC0] = recordStrm;
+    self->dispatch[0xC2] = recordArgc;
+    self->dispatch[0xC3] = recordArgv;
+    self->dispatch[0xD0] = recordOpen;
+    self->dispatch[0xD2] = recordGet;
+    self->dispatch[0xD4] = recordGetb;
+    self->dispatch[0xD8] = recordTell;
+    self->dispatch[0xD9] = recordSeek;
+  }
+  machine->iolog = self;
+  machine->dispatch = self->dispatch;
+}
@@ -0,0 +1,64 @@
+#ifndef IOLOG_H
+#define IOLOG_H
+
+#include "types.h"
+
+
+// Recording a program's input, and replaying it without touching the OS, so
+// that its runs can be timed as pure computation.
+//
+// A recording machine runs as normal, but logs the results of every
+// instruction that brings information in from outside: `STRM`, `ARGC`,
+// `ARGV`, `OPEN`, `GET`, `GETB`, `TELL` and `SEEK`. A replaying machine
+// takes those results from the log instead. Since it never opens anything,
+// its file handles are just distinct non-NULL numbers, and output (`PUT`,
+// `PUTB`, `FLUS`, `CLOS`) goes nowhere; it is only counted and checksummed,
+// so that runs can still be compared. A program that asks for input other
+// than what was recorded has diverged from the log, and is halted. So is one
+// that uses asynchronous I/O, whose completions come in no fixed order, or
+// maps shared memory, which other processes change behind its back.
+//
+// As with the tables in debug.h, this works by swapping the machine's dispatch
+// table, here for a copy of the normal one with only the I/O instructions
+// replaced. All other instructions run exactly as they normally would, at no
+// extra cost.
+//
+// A log is the magic number "BsvmIoL1", then one entry per input instruction
+// executed: its opcode, followed by
+//   ARGC: the count
+//   ARGV: the length of the argument, then its bytes and a NUL
+//   OPEN: 1 if the file opened, otherwise 0
+//   GET: the count left in `src`, then the bytes read
+//   GETB, TELL, SEEK: the value stored
+// `STRM` has nothing more. Numbers are LEB128 varints, zigzag-encoded where
+// they may be negative.
+
+typedef struct IoLog IoLog;
+struct IoLog {
+  bool replaying;
+  bool failed; // a write to the log failed, or the replay diverged
+  FILE* out; // when recording
+  struct {
+    byte* at;
+    size_t len;
+    size_t next; // how much has been replayed
+  } in; // when replaying
+  uintptr_t handles; // handed out so far, when replaying
+  struct {
+    uint64_t bytes;
+    uint64_t hash; // FNV-1a
+  } output; // when replaying
+  OpHandler dispatch[256]; // see `attachIoLog`
+};
+// Create a new log file to record into, or read a whole log into memory to
+// replay from. Return 0 on success.
+int openIoLogRecord(IoLog* out, const char* filename);
+int openIoLogReplay(IoLog* out, const char* filename);
+// Return 0 unless something went wrong during recording or replay.
+int closeIoLog(IoLog* self);
+
+// Point the machine at the log, and its dispatch at the table for it.
+void attachIoLog(Machine* machine, IoLog* self);
+
+
+#endif
@@ -0,0 +1,119 @@
+#include "bsvm.h"
+
+#include "common.h"
+#include "execute.h"
+#include "hostio.h"
+#include "loader.h"
+#include "types.h"
+
+
+struct BsvmProgram {
+  Program prog;
+};
+
+struct BsvmMachine {
+  bool started; // whether `machine` has been initialized
+  Machine machine;
+  FILE* hostStreams[3]; // NULL for a standard stream
+};
+
+
+////// Programs //////
+
+BsvmProgram* bsvmLoadFile(const char* filename) {
+  BsvmProgram* self = malloc(sizeof(BsvmProgram));
+  if (self == NULL) { return NULL; }
+  if (readProgram(&self->prog, filename)) {
+    free(self);
+    return NULL;
+  }
+  return self;
+}
+
+BsvmProgram* bsvmLoadBuffer(const void* buf, size_t len) {
+  BsvmProgram* self = malloc(sizeof(BsvmProgram));
+  if (self == NULL) { return NULL; }
+  if (readProgramBuffer(&self->prog, buf, len)) {
+    free(self);
+    return NULL;
+  }
+  return self;
+}
+
+void bsvmFreeProgram(BsvmProgram* self) {
+  if (self == NULL) { return; }
+  freeProgram(&self->prog);
+  free(self);
+}
+
+
+////// Machines //////
+
+BsvmMachine* bsvmNewMachine(void) {
+  BsvmMachine* self = malloc(sizeof(BsvmMachine));
+  if (self == NULL) { return NULL; }
+  self->started = false;
+  for (int i = 0; i < 3; ++i) { self->hostStreams[i] = NULL; }
+  return self;
+}
+
+void bsvmFreeMachine(BsvmMachine* self) {
+  if (self == NULL) { return; }
+  if (self->started) {
+    // nothing may still be reading into the blocks about to be freed
+    destroyAsyncIo(self->machine.aio);
+    self->machine.aio = NULL;
+    heapFreeAll(&self->machine.heap);
+    destroyMachine(&self->machine);
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (self->hostStreams[i] != NULL) { fclose(self->hostStreams[i]); }
+  }
+  free(self);
+}
+
+int bsvmSetStream(BsvmMachine* self, int id, void* ctx, BsvmReadFn read, BsvmWriteFn write) {
+  if (id < 0 || 3 <= id) { return -1; }
+  FILE* fp = openHostStream(ctx, read, write);
+  if (fp == NULL) { return -1; }
+  if (self->hostStreams[id] != NULL) { fclose(self->hostStreams[id]); }
+  self->hostStreams[id] = fp;
+  if (self->started) { self->machine.streams[id] = fp; }
+  return 0;
+}
+
+int bsvmStart(BsvmMachine* self, BsvmProgram* prog, size_t argc, char** argv) {
+  if (!self->started) {
+    if (initMachine(&self->machine, &prog->prog, argc, argv)) { return -1; }
+    // tracked, so that restarting can reclaim whatever a program leaked
+    initHeap(&self->machine.heap, HEAP_LIBC, false, true);
+    self->started = true;
+  }
+  else if (resetMachine(&self->machine, &prog->prog, argc, argv)) {
+    // the machine is left without a program; `bsvmStart` it again to retry
+    self->machine.shouldHalt = true;
+    self->machine.fuel = UINT64_MAX;
+    return -1;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (self->hostStreams[i] != NULL) { self->machine.streams[i] = self->hostStreams[i]; }
+  }
+  return 0;
+}
+
+BsvmStatus bsvmRun(BsvmMachine* self, uint64_t fuel) {
+  if (!self->started) { return BSVM_IDLE; }
+  Machine* machine = &self->machine;
+  refuel(machine, fuel == 0 ? UINT64_MAX : fuel);
+  while (!machine->shouldHalt) {
+    cycle(machine);
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (self->hostStreams[i] != NULL) { fflush(self->hostStreams[i]); }
+  }
+  return isOutOfFuel(machine) ? BSVM_OUT_OF_FUEL : BSVM_EXITED;
+}
+
+int bsvmExitCode(const BsvmMachine* self) {
+  return self->machine.exitcode;
+}
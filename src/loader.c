@@ -1,12 +1,28 @@
+#define _XOPEN_SOURCE 700
+
 #include "common.h"
 #include "types.h"
 
 #include "loader.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
 
-int readProgram(Program* out, const char* filename) {
-  FILE* fp = fopen(filename, "r");
-  if (fp == NULL) { goto badexit; }
+// read-only data starts on a page of its own, so it can be mapped separately
+#define PAGE_BYTES 4096
+
+// Programs are allocated in pages of this size: the host's, or the ones the
+// assembler lays read-only data out for, if those are bigger.
+static size_t programPage_bytes(void) {
+  long page = sysconf(_SC_PAGESIZE);
+  return page > PAGE_BYTES ? (size_t)page : PAGE_BYTES;
+}
+
+static size_t roundToPages(size_t size_bytes, size_t page_bytes) {
+  return (size_bytes + page_bytes - 1) / page_bytes * page_bytes;
+}
+
+static int parseProgram(Program* out, FILE* fp) {
   // If the first two bytes are #!, skip through the first newline character, then continue.
   // Otherwise, look for the 8-byte magic number.
   {
@@ -53,23 +69,102 @@ int readProgram(Program* out, const char* filename) {
   }
   // next `out->codeSize_bytes` bytes is the bytecode
   {
-    byte* codebuf = malloc(sizeof(byte) * out->codeSize_bytes);
+    byte* codebuf = allocProgramCode(out->codeSize_bytes);
+    if (codebuf == NULL) { goto badexit; }
     size_t read_bytes = fread(codebuf, 1, out->codeSize_bytes, fp);
     if (read_bytes != out->codeSize_bytes) { free(codebuf); goto badexit; }
     out->code = codebuf;
+    out->rodataSize_bytes = 0;
+  }
+  // optionally, read-only data follows: the magic number "BsvmRod1", the offset from the start of
+  // the code where it is loaded (a multiple of the page size, past the code), and its size, both
+  // 4 bytes big-endian, then the data itself
+  {
+    char magic[8];
+    size_t read_bytes = fread(magic, 1, 8, fp);
+    if (read_bytes == 0 && feof(fp)) {
+      protectProgram(out);
+      return 0;
+    }
+    if (read_bytes != 8 || strncmp((const char*)&magic, "BsvmRod1", 8) != 0) { goto badcode; }
+    size_t offset = 0, size = 0;
+    for (int i = 0; i < 8; ++i) {
+      byte c = fgetc(fp);
+      if (feof(fp)) { goto badcode; }
+      if (i < 4) { offset = (offset << 8) + c; }
+      else { size = (size << 8) + c; }
+    }
+    if (offset < out->codeSize_bytes || offset % PAGE_BYTES != 0) { goto badcode; }
+    byte* image = allocProgramCode(offset + size);
+    if (image == NULL) { goto badcode; }
+    memcpy(image, out->code, out->codeSize_bytes);
+    memset(image + out->codeSize_bytes, 0, offset - out->codeSize_bytes);
+    read_bytes = fread(image + offset, 1, size, fp);
+    if (read_bytes != size) { free(image); goto badcode; }
+    free(out->code);
+    out->code = image;
+    out->codeSize_bytes = offset + size;
+    out->rodataSize_bytes = size;
+    protectProgram(out);
   }
-  // TODO more header info (size/location of symtab and comments) after the bytecode, probably aligned to 16 bytes
-  fclose(fp);
   return 0;
+  badcode: {
+    free(out->code);
+  }
   badexit: {
-    fclose(fp);
     return -1;
   }
 }
 
+int readProgram(Program* out, const char* filename) {
+  FILE* fp = fopen(filename, "r");
+  if (fp == NULL) { return -1; }
+  int err = parseProgram(out, fp);
+  fclose(fp);
+  return err;
+}
+
+// As `readProgram`, but from the contents of a bytecode file already in memory.
+int readProgramBuffer(Program* out, const byte* buf, size_t len) {
+  if (len == 0) { return -1; }
+  FILE* fp = fmemopen((void*)buf, len, "r");
+  if (fp == NULL) { return -1; }
+  int err = parseProgram(out, fp);
+  fclose(fp);
+  return err;
+}
+
+// Memory for a program's code, starting on a page and filling whole pages, so
+// that it can be protected. Until then, free it as `free` would.
+byte* allocProgramCode(size_t size_bytes) {
+  size_t page = programPage_bytes();
+  if (size_bytes > SIZE_MAX - page) { return NULL; }
+  void* out;
+  size_t alloc_bytes = size_bytes == 0 ? page : roundToPages(size_bytes, page);
+  if (posix_memalign(&out, page, alloc_bytes) != 0) { return NULL; }
+  return out;
+}
+
+// Make a program from `allocProgramCode`, code and read-only data alike,
+// read-only in fact. The assembler merges identical data, so a write through
+// one label could change another; and the indirect call cache (see
+// execute/opcodes.c) relies on the frame size of a function in the code never
+// changing.
+void protectProgram(Program* prog) {
+  mprotect(prog->code, roundToPages(prog->codeSize_bytes, programPage_bytes()), PROT_READ);
+}
+
+// Release the code of a loaded (or restored) program.
+void freeProgram(Program* prog) {
+  mprotect(prog->code, roundToPages(prog->codeSize_bytes, programPage_bytes()), PROT_READ | PROT_WRITE);
+  free(prog->code);
+  prog->code = NULL;
+}
+
 void fputProgram(FILE* fp, const Program* prog) {
   fprintf(fp, "Program {\n");
   fprintf(fp, "  codeSize_bytes = %ld\n", prog->codeSize_bytes);
+  fprintf(fp, "  rodataSize_bytes = %ld\n", prog->rodataSize_bytes);
   fprintf(fp, "  entrypoint = %ld\n", prog->entrypoint);
   fprintf(fp, "}\n");
 }
@@ -6,6 +6,11 @@
 
 
 int readProgram(Program* out, const char* filename);
+int readProgramBuffer(Program* out, const byte* buf, size_t len);
+void freeProgram(Program* prog);
+
+byte* allocProgramCode(size_t size_bytes);
+void protectProgram(Program* prog);
 
 void fputProgram(FILE* fp, const Program* prog);
 
@@ -2,30 +2,125 @@
 
 #include "types.h"
 #include "loader.h"
-#include "execute.h"
+#include "run.h"
+#include "serve.h"
 
 
+static void usage(void) {
+  fprintf(stderr, "usage: bsvm [--fuel <n>] [--heap libc|pool] [--heap-stats] [--gc]\n"
+                  "            [--perf-stats] [--aio uring|threads] [--snapshot <image>]\n"
+                  "            [--trace <file>] [--trace-records <n>] [--record <log> | --replay <log>]\n"
+                  "            <bytecode file> <args to program...>\n"
+                  "       bsvm [options...] --restore <image> <args to program...>\n"
+                  "       bsvm [options...] --serve <socket>\n");
+}
+
 int main(int argc, char** argv) {
-  if (argc < 1) {
-    fprintf(stderr, "usage: bsvm <bytecode file> <args to program...>\n");
+  RunOptions opts;
+  defaultRunOptions(&opts);
+  const char* serveSocket = NULL;
+  const char* restoreImage = NULL;
+  // options come before the bytecode file; everything after belongs to the program
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi) {
+    if (strcmp(argv[argi], "--fuel") == 0 && argi + 1 < argc) {
+      char* end;
+      opts.fuel = strtoull(argv[++argi], &end, 0);
+      if (*end != '\0' || opts.fuel == 0) {
+        fprintf(stderr, "[ERROR] --fuel expects a positive integer\n");
+        return 1;
+      }
+    }
+    else if (strcmp(argv[argi], "--heap") == 0 && argi + 1 < argc) {
+      const char* kind = argv[++argi];
+      if (strcmp(kind, "libc") == 0) { opts.heapKind = HEAP_LIBC; }
+      else if (strcmp(kind, "pool") == 0) { opts.heapKind = HEAP_POOL; }
+      else {
+        fprintf(stderr, "[ERROR] unknown heap kind: %s\n", kind);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[argi], "--aio") == 0 && argi + 1 < argc) {
+      const char* kind = argv[++argi];
+      if (strcmp(kind, "uring") == 0) { opts.aioKind = AIO_URING; }
+      else if (strcmp(kind, "threads") == 0) { opts.aioKind = AIO_THREADS; }
+      else {
+        fprintf(stderr, "[ERROR] unknown async I/O kind: %s\n", kind);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[argi], "--heap-stats") == 0) {
+      opts.heapStats = true;
+    }
+    else if (strcmp(argv[argi], "--perf-stats") == 0) {
+      opts.perfStats = true;
+    }
+    else if (strcmp(argv[argi], "--gc") == 0) {
+      opts.gc = true;
+    }
+    else if (strcmp(argv[argi], "--trace") == 0 && argi + 1 < argc) {
+      opts.tracePath = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "--trace-records") == 0 && argi + 1 < argc) {
+      char* end;
+      opts.traceRecords = strtoull(argv[++argi], &end, 0);
+      if (*end != '\0' || opts.traceRecords == 0) {
+        fprintf(stderr, "[ERROR] --trace-records expects a positive integer\n");
+        return 1;
+      }
+    }
+    else if (strcmp(argv[argi], "--record") == 0 && argi + 1 < argc) {
+      opts.recordPath = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "--replay") == 0 && argi + 1 < argc) {
+      opts.replayPath = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "--snapshot") == 0 && argi + 1 < argc) {
+      opts.snapshotPath = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "--restore") == 0 && argi + 1 < argc) {
+      // the image stands in for the bytecode file, including as argv[0]
+      restoreImage = argv[++argi];
+      break;
+    }
+    else if (strcmp(argv[argi], "--serve") == 0 && argi + 1 < argc) {
+      serveSocket = argv[++argi];
+    }
+    else if (strcmp(argv[argi], "--") == 0) {
+      ++argi;
+      break;
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+  // each of these needs the dispatch table to itself
+  if ((opts.recordPath != NULL) + (opts.replayPath != NULL) + (opts.tracePath != NULL) > 1) {
+    fprintf(stderr, "[ERROR] --record, --replay and --trace cannot be combined\n");
+    return 1;
+  }
+  if (serveSocket != NULL) {
+    if (argi != argc) {
+      usage();
+      return 1;
+    }
+    return serve(serveSocket, &opts);
+  }
+  if (restoreImage != NULL) {
+    return restoreProgram(restoreImage, argc-argi, argv+argi, &opts);
+  }
+  if (argi >= argc) {
+    usage();
     return 1;
   }
   Program prog;
-  Machine machine;
   // fprintf(stderr, "reading...\n");
-  if (readProgram(&prog, argv[1])) {
+  if (readProgram(&prog, argv[argi])) {
     fprintf(stderr, "[ERROR] when reading program\n");
     return -1;
   }
-  // fprintf(stderr, "initializing...\n");
-  initMachine(&machine, &prog, argc-1, argv+1);
-  // fprintf(stderr, "executing...\n");
-  // TODO I'm debating whether to use longjmp instead of testing a boolean every time
-  while(!machine.shouldHalt) {
-    // fprintf(stderr, "[INFO] %08lx: %02x\n", machine.ip - prog.code, *machine.ip);
-    cycle(&machine);
-  }
-  destroyMachine(&machine);
-  free(machine.program->code);
-  return machine.exitcode;
+  int exitcode = runProgram(&prog, argc-argi, argv+argi, &opts);
+  freeProgram(&prog);
+  return exitcode;
 }
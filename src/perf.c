@@ -0,0 +1,155 @@
+#define _GNU_SOURCE // for `syscall`
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perf.h"
+
+
+static const char* const counterNames[PERF_COUNTER_COUNT] = {
+  [PERF_CYCLES] = "cycles",
+  [PERF_INSTRUCTIONS] = "instructions",
+  [PERF_BRANCH_MISSES] = "branch misses",
+  [PERF_L1I_MISSES] = "L1i misses",
+  [PERF_L1D_MISSES] = "L1d misses",
+  [PERF_LLC_MISSES] = "LLC misses",
+};
+
+
+#ifdef __linux__
+
+#define CACHE_READ_MISSES(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct { uint32_t type; uint64_t config; } counterEvents[PERF_COUNTER_COUNT] = {
+  [PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  [PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  [PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  [PERF_L1I_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1I) },
+  [PERF_L1D_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D) },
+  [PERF_LLC_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL) },
+};
+
+size_t openPerfStats(PerfStats* out) {
+  size_t opened = 0;
+  out->err = 0;
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counterEvents[i].type;
+    attr.config = counterEvents[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    out->fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    out->counted[i] = false;
+    out->counts[i] = 0;
+    if (out->fds[i] >= 0) { opened += 1; }
+    else if (out->err == 0) { out->err = errno; }
+  }
+  return opened;
+}
+
+void startPerfStats(PerfStats* self) {
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    if (self->fds[i] < 0) { continue; }
+    ioctl(self->fds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(self->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void stopPerfStats(PerfStats* self) {
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    if (self->fds[i] >= 0) { ioctl(self->fds[i], PERF_EVENT_IOC_DISABLE, 0); }
+  }
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    if (self->fds[i] < 0) { continue; }
+    uint64_t value[3]; // count, time enabled, time running
+    // (a counter that never got onto the hardware has no count at all)
+    if (read(self->fds[i], value, sizeof(value)) == sizeof(value) && value[2] != 0) {
+      self->counts[i] = value[2] < value[1]
+                      ? (uint64_t)((double)value[0] * value[1] / value[2])
+                      : value[0];
+      self->counted[i] = true;
+    }
+    close(self->fds[i]);
+    self->fds[i] = -1;
+  }
+}
+
+#else
+
+size_t openPerfStats(PerfStats* out) {
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    out->fds[i] = -1;
+    out->counted[i] = false;
+    out->counts[i] = 0;
+  }
+  out->err = ENOSYS;
+  return 0;
+}
+
+void startPerfStats(PerfStats* self) { (void)self; }
+void stopPerfStats(PerfStats* self) { (void)self; }
+
+#endif
+
+
+// The usual reason for counters being refused, when it is the reason.
+static void fputParanoia(FILE* fp, int err) {
+  if (err != EACCES && err != EPERM) { return; }
+  FILE* setting = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+  int level;
+  if (setting != NULL && fscanf(setting, "%d", &level) == 1) {
+    fprintf(fp, "[PERF] (kernel.perf_event_paranoid is %d; counting needs 2 or less)\n", level);
+  }
+  if (setting != NULL) { fclose(setting); }
+}
+
+void fputPerfStats(FILE* fp, const PerfStats* self, uint64_t vmInstructions) {
+  fprintf(fp, "[PERF] %llu VM instructions\n", (unsigned long long)vmInstructions);
+  double perVm = vmInstructions != 0 ? 1.0 / vmInstructions : 0.0;
+  bool any = false;
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    if (!self->counted[i]) { continue; }
+    any = true;
+    fprintf(fp, "[PERF] %llu %s", (unsigned long long)self->counts[i], counterNames[i]);
+    switch (i) {
+      case PERF_CYCLES: {
+        fprintf(fp, ", %.2f host cycles per VM instruction", self->counts[i] * perVm);
+      } break;
+      case PERF_INSTRUCTIONS: {
+        fprintf(fp, ", %.2f host instructions per VM instruction", self->counts[i] * perVm);
+      } break;
+      case PERF_BRANCH_MISSES: {
+        fprintf(fp, ", %.4f mispredicts per dispatch", self->counts[i] * perVm);
+      } break;
+      default: {
+        fprintf(fp, ", %.4f per VM instruction", self->counts[i] * perVm);
+      } break;
+    }
+    fputc('\n', fp);
+  }
+  if (self->counted[PERF_CYCLES] && self->counted[PERF_INSTRUCTIONS] && self->counts[PERF_CYCLES] != 0) {
+    fprintf(fp, "[PERF] %.2f host instructions per cycle\n"
+           , (double)self->counts[PERF_INSTRUCTIONS] / self->counts[PERF_CYCLES]);
+  }
+  for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+    if (!self->counted[i]) {
+      fprintf(fp, "[PERF] %s: not available\n", counterNames[i]);
+    }
+  }
+  if (!any && self->err != 0) {
+    fprintf(fp, "[PERF] no hardware counters could be opened: %s\n", strerror(self->err));
+    fputParanoia(fp, self->err);
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include "common.h"
+
+
+// Hardware performance counters around a run, for `bsvm --perf-stats`.
+//
+// The counters are opened with `perf_event_open`, counting this process in
+// user mode only, which unprivileged processes may do unless
+// `perf_event_paranoid` is above 2. Each counter is opened separately, so that
+// the ones a CPU (or virtual machine) lacks don't take the others with them;
+// when the kernel has to share the hardware between them, their counts are
+// scaled up from the time each was actually running. Counters that could not
+// be opened are reported as such, and the run goes ahead regardless.
+
+typedef enum PerfCounter {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_BRANCH_MISSES,
+  PERF_L1I_MISSES,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_COUNTER_COUNT
+} PerfCounter;
+
+typedef struct PerfStats PerfStats;
+struct PerfStats {
+  int fds[PERF_COUNTER_COUNT]; // -1 when not open
+  int err; // errno from the first counter that couldn't be opened
+  bool counted[PERF_COUNTER_COUNT]; // whether counts[i] means anything
+  uint64_t counts[PERF_COUNTER_COUNT];
+};
+
+// Open whichever counters can be had, all stopped. Return how many.
+size_t openPerfStats(PerfStats* out);
+void startPerfStats(PerfStats* self);
+// Stop counting, take the counts, and close the counters.
+void stopPerfStats(PerfStats* self);
+
+// Report the counts, per VM instruction where that means anything.
+void fputPerfStats(FILE* fp, const PerfStats* self, uint64_t vmInstructions);
+
+
+#endif
@@ -0,0 +1,135 @@
+#include "run.h"
+
+#include "debug.h"
+#include "execute.h"
+#include "gc.h"
+#include "iolog.h"
+#include "loader.h"
+#include "perf.h"
+#include "snapshot.h"
+
+
+void defaultRunOptions(RunOptions* out) {
+  out->fuel = 0;
+  out->heapKind = HEAP_LIBC;
+  out->heapStats = false;
+  out->perfStats = false;
+  out->gc = false;
+  out->aioKind = AIO_AUTO;
+  out->snapshotPath = NULL;
+  out->tracePath = NULL;
+  out->traceRecords = 65536;
+  out->recordPath = NULL;
+  out->replayPath = NULL;
+}
+
+static void setupHeap(Heap* heap, const RunOptions* opts) {
+  // only a tracked heap can be written into a snapshot, or collected
+  initHeap(heap, opts->heapKind, opts->heapStats, opts->snapshotPath != NULL || opts->gc);
+  if (opts->gc) { enableGc(heap); }
+}
+
+// Execute an initialized machine until it exits (or runs out of fuel), then
+// destroy it.
+static int runMachine(Machine* machine, const RunOptions* opts) {
+  refuel(machine, opts->fuel);
+  machine->aioKind = opts->aioKind;
+  machine->snapshotPath = opts->snapshotPath;
+  Debugger debugger;
+  if (opts->tracePath != NULL) {
+    if (initDebugger(&debugger, opts->traceRecords)) {
+      fprintf(stderr, "[ERROR] out of memory for trace\n");
+      destroyMachine(machine);
+      return -1;
+    }
+    attachDebugger(machine, &debugger);
+    machine->dispatch = tracingDispatch;
+  }
+  IoLog iolog;
+  const char* logPath = opts->replayPath != NULL ? opts->replayPath : opts->recordPath;
+  if (logPath != NULL) {
+    int err = opts->replayPath != NULL
+            ? openIoLogReplay(&iolog, logPath)
+            : openIoLogRecord(&iolog, logPath);
+    if (err) {
+      fprintf(stderr, "[ERROR] could not open I/O log %s\n", logPath);
+      if (opts->tracePath != NULL) { destroyDebugger(&debugger); }
+      destroyMachine(machine);
+      return -1;
+    }
+    attachIoLog(machine, &iolog);
+  }
+  // fprintf(stderr, "executing...\n");
+  // TODO I'm debating whether to use longjmp instead of testing a boolean every time
+  PerfStats perf;
+  uint64_t executed = 0;
+  if (opts->perfStats) {
+    // a loop of its own, so that only measured runs pay for counting (and the
+    // count costs them one host instruction per VM instruction)
+    openPerfStats(&perf);
+    startPerfStats(&perf);
+    while(!machine->shouldHalt) {
+      cycle(machine);
+      executed += 1;
+    }
+    stopPerfStats(&perf);
+  }
+  else {
+    while(!machine->shouldHalt) {
+      cycle(machine);
+    }
+  }
+  if (isOutOfFuel(machine)) {
+    fprintf(stderr, "[ERROR] out of fuel at %08lx\n", (long)(machine->ip - machine->program->code));
+  }
+  if (opts->heapStats) {
+    fputHeapStats(stderr, &machine->heap);
+  }
+  if (opts->perfStats) {
+    fputPerfStats(stderr, &perf, executed);
+  }
+  if (logPath != NULL) {
+    if (iolog.replaying) {
+      fprintf(stderr, "[REPLAY] %llu bytes of output, checksum %016llx\n"
+             , (unsigned long long)iolog.output.bytes, (unsigned long long)iolog.output.hash);
+    }
+    if (closeIoLog(&iolog) && !iolog.replaying) {
+      fprintf(stderr, "[ERROR] could not write I/O log to %s\n", logPath);
+    }
+  }
+  if (opts->tracePath != NULL) {
+    FILE* fp = fopen(opts->tracePath, "w");
+    if (fp == NULL || writeTrace(&debugger, fp)) {
+      fprintf(stderr, "[ERROR] could not write trace to %s\n", opts->tracePath);
+    }
+    if (fp != NULL) { fclose(fp); }
+    destroyDebugger(&debugger);
+  }
+  destroyMachine(machine);
+  return machine->exitcode;
+}
+
+int runProgram(Program* prog, size_t argc, char** argv, const RunOptions* opts) {
+  Machine machine;
+  // fprintf(stderr, "initializing...\n");
+  if (initMachine(&machine, prog, argc, argv)) {
+    fprintf(stderr, "[ERROR] when initializing machine\n");
+    return -1;
+  }
+  setupHeap(&machine.heap, opts);
+  return runMachine(&machine, opts);
+}
+
+int restoreProgram(const char* filename, size_t argc, char** argv, const RunOptions* opts) {
+  Machine machine;
+  Program prog = { .code = NULL, .codeSize_bytes = 0, .rodataSize_bytes = 0, .entrypoint = 0 };
+  setupHeap(&machine.heap, opts);
+  if (readSnapshot(&machine, &prog, filename, argc, argv)) {
+    fprintf(stderr, "[ERROR] when reading snapshot\n");
+    destroyHeap(&machine.heap);
+    return -1;
+  }
+  int exitcode = runMachine(&machine, opts);
+  freeProgram(&prog);
+  return exitcode;
+}
@@ -0,0 +1,33 @@
+#ifndef RUN_H
+#define RUN_H
+
+#include "types.h"
+
+
+// Settings for one run of a program, as given on the command line.
+typedef struct RunOptions RunOptions;
+struct RunOptions {
+  uint64_t fuel; // zero means unmetered
+  HeapKind heapKind;
+  bool heapStats;
+  bool perfStats; // report hardware counters for the run (see perf.h)
+  bool gc; // collect unreachable `NEW` blocks (see gc.h)
+  AioKind aioKind;
+  const char* snapshotPath; // where `SNAP` writes its image (NULL disables it)
+  const char* tracePath; // where to write an instruction trace (NULL disables it)
+  size_t traceRecords; // how many of the most recent instructions the trace keeps
+  const char* recordPath; // where to log the program's input (NULL disables it; see iolog.h)
+  const char* replayPath; // where to replay the program's input from, instead of the OS
+};
+void defaultRunOptions(RunOptions* out);
+
+// Execute a loaded program from its entrypoint until it exits (or runs out of
+// fuel), reporting any requested diagnostics on stderr.
+// Returns the exit code.
+int runProgram(Program* prog, size_t argc, char** argv, const RunOptions* opts);
+
+// As `runProgram`, but resume a machine from an image written by `SNAP`.
+int restoreProgram(const char* filename, size_t argc, char** argv, const RunOptions* opts);
+
+
+#endif
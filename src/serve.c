@@ -0,0 +1,199 @@
+#define _XOPEN_SOURCE 700
+
+#include "serve.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "loader.h"
+
+
+// A program is reloaded whenever its file's modification time or size changes.
+typedef struct CachedProgram CachedProgram;
+struct CachedProgram {
+  CachedProgram* next;
+  char* path;
+  struct timespec mtime;
+  off_t size;
+  Program prog;
+};
+static CachedProgram* cache = NULL;
+
+static Program* lookupProgram(const char* path) {
+  struct stat st;
+  if (stat(path, &st) != 0) { return NULL; }
+  CachedProgram** link = &cache;
+  for (CachedProgram* entry = cache; entry != NULL; link = &entry->next, entry = entry->next) {
+    if (strcmp(entry->path, path) != 0) { continue; }
+    if (entry->mtime.tv_sec == st.st_mtim.tv_sec
+        && entry->mtime.tv_nsec == st.st_mtim.tv_nsec
+        && entry->size == st.st_size) {
+      return &entry->prog;
+    }
+    // stale: drop it and load afresh below
+    *link = entry->next;
+    freeProgram(&entry->prog);
+    free(entry->path);
+    free(entry);
+    break;
+  }
+  CachedProgram* entry = malloc(sizeof(CachedProgram));
+  if (entry == NULL) { return NULL; }
+  entry->path = strdup(path);
+  if (entry->path == NULL || readProgram(&entry->prog, path)) {
+    free(entry->path);
+    free(entry);
+    return NULL;
+  }
+  entry->mtime = st.st_mtim;
+  entry->size = st.st_size;
+  entry->next = cache;
+  cache = entry;
+  return &entry->prog;
+}
+
+
+static bool readAll(int fd, void* buf, size_t len) {
+  byte* p = buf;
+  while (len != 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { return false; }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Receive the request header along with the client's standard streams.
+static bool recvRequest(int conn, ServeRequest* req, int fds[3]) {
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { .iov_base = req, .iov_len = sizeof(ServeRequest) };
+  struct msghdr msg = {
+    .msg_iov = &iov,
+    .msg_iovlen = 1,
+    .msg_control = control.buf,
+    .msg_controllen = sizeof(control.buf),
+  };
+  ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+  if (n <= 0) { return false; }
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL
+      || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+      || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+    return false;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  if (!readAll(conn, (byte*)req + n, sizeof(ServeRequest) - n)
+      || req->magic != SERVE_MAGIC || req->argc == 0
+      || req->argc > SERVE_MAX_ARGC || req->payload_bytes > SERVE_MAX_PAYLOAD_BYTES) {
+    for (int i = 0; i < 3; ++i) { close(fds[i]); }
+    return false;
+  }
+  return true;
+}
+
+// Runs in the forked child: become the client's process, as far as the
+// program can tell, and report back the exit code.
+static void handleRequest(int conn, int fds[3], char* payload, uint32_t argc, Program* prog, const RunOptions* opts) {
+  char** argv = malloc(sizeof(char*) * argc);
+  if (argv == NULL) { _exit(1); }
+  char* cwd = payload;
+  char* arg = cwd + strlen(cwd) + 1;
+  for (uint32_t i = 0; i < argc; ++i) {
+    argv[i] = arg;
+    arg += strlen(arg) + 1;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (dup2(fds[i], i) < 0) { _exit(1); }
+    close(fds[i]);
+  }
+  signal(SIGPIPE, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  int32_t exitcode = -1;
+  if (chdir(cwd) != 0) {
+    fprintf(stderr, "[ERROR] cannot enter working directory %s\n", cwd);
+  }
+  else if (prog == NULL) {
+    fprintf(stderr, "[ERROR] when reading program\n");
+  }
+  else {
+    exitcode = runProgram(prog, argc, argv, opts);
+  }
+  fflush(stdout);
+  fflush(stderr);
+  if (write(conn, &exitcode, sizeof(exitcode)) != sizeof(exitcode)) { _exit(1); }
+  _exit(0);
+}
+
+int serve(const char* socketPath, const RunOptions* opts) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "[ERROR] socket path too long: %s\n", socketPath);
+    return 1;
+  }
+  strcpy(addr.sun_path, socketPath);
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) { perror("[ERROR] socket"); return 1; }
+  unlink(socketPath);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    perror("[ERROR] bind");
+    close(sock);
+    return 1;
+  }
+  if (listen(sock, 64) != 0) {
+    perror("[ERROR] listen");
+    close(sock);
+    return 1;
+  }
+  // children are never waited on, and clients may hang up at any time
+  signal(SIGCHLD, SIG_IGN);
+  signal(SIGPIPE, SIG_IGN);
+  for (;;) {
+    int conn = accept(sock, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) { continue; }
+      perror("[ERROR] accept");
+      close(sock);
+      return 1;
+    }
+    // a client that stops sending mid-request would hold up everyone else
+    struct timeval timeout = { .tv_sec = SERVE_RECV_TIMEOUT_SECONDS, .tv_usec = 0 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ServeRequest req;
+    int fds[3];
+    char* payload = NULL;
+    if (!recvRequest(conn, &req, fds)) { close(conn); continue; }
+    payload = malloc((size_t)req.payload_bytes + 1);
+    if (payload == NULL || !readAll(conn, payload, req.payload_bytes)) { goto done; }
+    // make sure every string is terminated, even if the client lied
+    payload[req.payload_bytes] = '\0';
+    {
+      size_t strings = 0;
+      for (size_t i = 0; i < req.payload_bytes; ++i) { strings += payload[i] == '\0'; }
+      if (strings < (size_t)req.argc + 1) { goto done; }
+    }
+    // load in the parent, so that the next request finds it in the cache
+    Program* prog = lookupProgram(payload + strlen(payload) + 1);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(sock);
+      handleRequest(conn, fds, payload, req.argc, prog, opts);
+    }
+    else if (pid < 0) {
+      perror("[ERROR] fork");
+    }
+  done:
+    free(payload);
+    for (int i = 0; i < 3; ++i) { close(fds[i]); }
+    close(conn);
+  }
+}
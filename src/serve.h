@@ -0,0 +1,43 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "common.h"
+#include "run.h"
+
+
+// Wire protocol between `bsvm --serve` and its client, `bsvmc`.
+//
+// Over a Unix-domain stream socket, the client sends one `ServeRequest`
+// together with its stdin/stdout/stderr (as SCM_RIGHTS ancillary data),
+// followed by `payload_bytes` bytes: the client's working directory and then
+// `argc` arguments, each NUL-terminated. The first argument is the absolute
+// path of the bytecode file. Once the program has finished, the server answers
+// with its exit code as an `int32_t`. Both ends share a host, so everything is
+// in native byte order.
+#define SERVE_MAGIC 0x42737652u // "BsvR"
+
+// The server turns away requests bigger than this, before allocating for them,
+// and hangs up on clients that go quiet for longer than the timeout partway
+// through sending one (it reads requests one at a time).
+#define SERVE_MAX_PAYLOAD_BYTES ((uint32_t)1 << 20)
+#define SERVE_MAX_ARGC ((uint32_t)1 << 16)
+#define SERVE_RECV_TIMEOUT_SECONDS 5
+
+typedef struct ServeRequest ServeRequest;
+struct ServeRequest {
+  uint32_t magic;
+  uint32_t argc;
+  uint32_t payload_bytes;
+};
+
+// Environment variable naming the socket when the client isn't told otherwise.
+#define SERVE_SOCKET_ENV "BSVM_SOCKET"
+
+// Listen on the given socket path forever, running each request in a fresh
+// machine (in a forked child) with the given options.
+// Loaded programs are cached by path and modification time.
+// Only returns on error.
+int serve(const char* socketPath, const RunOptions* opts);
+
+
+#endif
@@ -0,0 +1,75 @@
+#define _GNU_SOURCE // for `syscall`
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "shm.h"
+
+
+byte* mapShared(const char* name, size_t size, bool create) {
+  if (size == 0) { return NULL; }
+  int fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0600);
+  if (fd < 0) { return NULL; }
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok && (size_t)st.st_size < size) {
+    // touching the mapping past the end of the object would be SIGBUS
+    ok = create && ftruncate(fd, size) == 0;
+  }
+  void* at = ok ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  return at == MAP_FAILED ? NULL : at;
+}
+
+void unmapShared(byte* at, size_t size) {
+  munmap(at, size);
+}
+
+int removeShared(const char* name) {
+  return shm_unlink(name) == 0 ? 0 : 1;
+}
+
+
+#ifdef __linux__
+
+// The 32 bits of a word that a futex can watch: its low half.
+static uint32_t* lowHalf(word* at) {
+  uint32_t* halves = (uint32_t*)at;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return &halves[1];
+#else
+  return &halves[0];
+#endif
+}
+
+// Not `FUTEX_PRIVATE_FLAG`: the other side is usually another process.
+void futexWait(word* at, word expected) {
+  syscall(SYS_futex, lowHalf(at), FUTEX_WAIT, (uint32_t)expected.bits, NULL, NULL, 0);
+}
+
+size_t futexWake(word* at, size_t n) {
+  long woken = syscall(SYS_futex, lowHalf(at), FUTEX_WAKE, n > INT_MAX ? INT_MAX : (int)n, NULL, NULL, 0);
+  return woken < 0 ? 0 : woken;
+}
+
+#else
+
+void futexWait(word* at, word expected) {
+  if (__atomic_load_n(&at->bits, __ATOMIC_SEQ_CST) == expected.bits) { sched_yield(); }
+}
+
+size_t futexWake(word* at, size_t n) {
+  (void)at; (void)n;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "common.h"
+
+
+// Named shared memory and futexes, behind `SHM`/`UNSHM`/`SHMRM`/`WAIT`/`WAKE`.
+//
+// A segment is a POSIX shared-memory object (`shm_open`), mapped read/write
+// wherever the OS likes; every process that maps the same name sees the same
+// bytes. Waiting and waking are done on a word in such memory, with a futex on
+// Linux. Elsewhere, waiting just yields the processor, which is correct (if
+// wasteful) as long as waiters re-check what they were waiting for.
+
+// Map `size` bytes of the named segment, creating it (or growing it to that
+// size) first if `create` is set. Return NULL on failure, including when an
+// existing segment is too small.
+byte* mapShared(const char* name, size_t size, bool create);
+void unmapShared(byte* at, size_t size);
+// Remove the name; mappings already made stay valid. Return 0 on success.
+int removeShared(const char* name);
+
+// Sleep while the word at `at` still holds `expected`, until woken by
+// `futexWake` on the same word (or spuriously). The kernel compares only the
+// low 32 bits, so the word should change by less than 2^32 in one go.
+void futexWait(word* at, word expected);
+// Wake at most `n` waiters. Return the number woken.
+size_t futexWake(word* at, size_t n);
+
+
+#endif
@@ -0,0 +1,269 @@
+#include "snapshot.h"
+
+#include "execute.h"
+#include "loader.h"
+
+
+// An image is laid out as follows, all numbers being native-endian u64:
+//   * the magic number "BsvmImg2"
+//   * a header: word size in bytes, entrypoint, size of the read-only data at
+//     the end of the code, offset of ip into the code, count of frames, count of globals, capacity of the retarray, and count of
+//     heap blocks
+//   * the regions of memory, each a size in bytes and an allocation site (only
+//     meaningful for heap blocks) followed by the raw bytes; they are given in
+//     the order code, frames (top first), globals, retarray, heap blocks
+//   * the relocations, each a region index, a byte offset into that region, a
+//     target (a region index or a stream) and a byte offset into the target;
+//     the list ends with a region index of `RELOC_END`
+static const char magic[8] = "BsvmImg2";
+
+#define TARGET_STDIN (UINT64_MAX - 3)
+#define TARGET_STDOUT (UINT64_MAX - 2)
+#define TARGET_STDERR (UINT64_MAX - 1)
+#define RELOC_END UINT64_MAX
+
+typedef struct Region Region;
+struct Region {
+  byte* start;
+  uint64_t size_bytes;
+  uint64_t site;
+};
+
+static bool putU64(FILE* fp, uint64_t n) {
+  return fwrite(&n, sizeof(n), 1, fp) == 1;
+}
+
+static bool getU64(FILE* fp, uint64_t* out) {
+  return fread(out, sizeof(*out), 1, fp) == 1;
+}
+
+static size_t frameBytes(const StackFrame* frame) {
+  return sizeof(StackFrame) + sizeof(word) * frame->size_words;
+}
+
+
+////// Writing //////
+
+// Fill `out` (when non-NULL) with the machine's regions in image order, and
+// return how many there are.
+static size_t listRegions(const Machine* self, Region* out) {
+  size_t n = 0;
+  #define PUT(startp, size, st) do { \
+      if (out != NULL) { out[n] = (Region){ .start = (byte*)(startp), .size_bytes = (size), .site = (st) }; } \
+      ++n; \
+    } while (0)
+  PUT(self->program->code, self->program->codeSize_bytes, 0);
+  for (const StackFrame* frame = self->top; frame != NULL; frame = frame->prev) {
+    PUT(frame, frameBytes(frame), 0);
+  }
+  PUT(self->global.at, sizeof(word) * self->global.len, 0);
+  PUT(self->retarray.bufp, sizeof(word) * self->retarray.cap, 0);
+  for (void* block = heapNext(&self->heap, NULL); block != NULL; block = heapNext(&self->heap, block)) {
+    PUT(block, heapBlockSize(&self->heap, block), heapBlockSite(&self->heap, block));
+  }
+  #undef PUT
+  return n;
+}
+
+static int compareStarts(const void* a, const void* b) {
+  uintptr_t x = (uintptr_t)(*(Region* const*)a)->start;
+  uintptr_t y = (uintptr_t)(*(Region* const*)b)->start;
+  return (x > y) - (x < y);
+}
+
+// Decide where a word found in memory points, if anywhere we can relocate.
+// Pointers one past the end of a region count as pointing into it.
+static bool findTarget(const Machine* self, const Region* regions, Region* const* sorted, size_t sorted_len
+                      , uintptr_t ptr, uint64_t* target, uint64_t* addend) {
+  if (ptr == 0) { return false; }
+  *addend = 0;
+  if (ptr == (uintptr_t)self->streams[0]) { *target = TARGET_STDIN; return true; }
+  if (ptr == (uintptr_t)self->streams[1]) { *target = TARGET_STDOUT; return true; }
+  if (ptr == (uintptr_t)self->streams[2]) { *target = TARGET_STDERR; return true; }
+  // find the last region starting at or before ptr
+  size_t lo = 0, hi = sorted_len;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if ((uintptr_t)sorted[mid]->start <= ptr) { lo = mid + 1; }
+    else { hi = mid; }
+  }
+  if (lo == 0) { return false; }
+  const Region* region = sorted[lo - 1];
+  uintptr_t off = ptr - (uintptr_t)region->start;
+  if (off > region->size_bytes) { return false; }
+  *target = region - regions;
+  *addend = off;
+  return true;
+}
+
+int writeSnapshot(const Machine* self, const char* filename) {
+  if (!self->heap.tracked) { return -1; }
+  size_t frame_count = 0;
+  for (const StackFrame* frame = self->top; frame != NULL; frame = frame->prev) { ++frame_count; }
+  size_t count = listRegions(self, NULL);
+  Region* regions = malloc(sizeof(Region) * count);
+  Region** sorted = malloc(sizeof(Region*) * count);
+  FILE* fp = NULL;
+  if (regions == NULL || sorted == NULL) { goto badexit; }
+  listRegions(self, regions);
+  // empty regions cannot be pointed into
+  size_t sorted_len = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (regions[i].size_bytes != 0) { sorted[sorted_len++] = &regions[i]; }
+  }
+  qsort(sorted, sorted_len, sizeof(Region*), compareStarts);
+
+  fp = fopen(filename, "w");
+  if (fp == NULL) { goto badexit; }
+  bool ok = fwrite(magic, 1, sizeof(magic), fp) == sizeof(magic)
+         && putU64(fp, sizeof(word))
+         && putU64(fp, self->program->entrypoint)
+         && putU64(fp, self->program->rodataSize_bytes)
+         && putU64(fp, self->ip - self->program->code)
+         && putU64(fp, frame_count)
+         && putU64(fp, self->global.len)
+         && putU64(fp, self->retarray.cap)
+         && putU64(fp, count - 3 - frame_count);
+  for (size_t i = 0; ok && i < count; ++i) {
+    ok = putU64(fp, regions[i].size_bytes)
+      && putU64(fp, regions[i].site)
+      && fwrite(regions[i].start, 1, regions[i].size_bytes, fp) == regions[i].size_bytes;
+  }
+  // the code is never scanned: nothing it contains is a host address
+  for (size_t i = 1; ok && i < count; ++i) {
+    for (size_t off = 0; ok && off + sizeof(word) <= regions[i].size_bytes; off += sizeof(word)) {
+      uintptr_t ptr;
+      memcpy(&ptr, regions[i].start + off, sizeof(ptr));
+      uint64_t target, addend;
+      if (findTarget(self, regions, sorted, sorted_len, ptr, &target, &addend)) {
+        ok = putU64(fp, i) && putU64(fp, off) && putU64(fp, target) && putU64(fp, addend);
+      }
+    }
+  }
+  ok = ok && putU64(fp, RELOC_END);
+  if (fclose(fp) != 0) { ok = false; }
+  fp = NULL;
+  if (!ok) { goto badexit; }
+  free(regions);
+  free(sorted);
+  return 0;
+  badexit: {
+    if (fp != NULL) { fclose(fp); }
+    free(regions);
+    free(sorted);
+    return -1;
+  }
+}
+
+
+////// Reading //////
+
+int readSnapshot(Machine* out, Program* prog, const char* filename, size_t argc, char** argv) {
+  FILE* fp = fopen(filename, "r");
+  if (fp == NULL) { return -1; }
+  initMachineState(out);
+  Region* regions = NULL;
+  size_t loaded = 0, frame_count = 0, count = 0;
+  size_t globals_ix = 0, retarray_ix = 0;
+  uint64_t ip_offset, global_len, retarray_cap, block_count;
+  {
+    char check[sizeof(magic)];
+    uint64_t word_bytes, entrypoint, rodata_bytes, frames;
+    if (fread(check, 1, sizeof(check), fp) != sizeof(check)) { goto badexit; }
+    if (memcmp(check, magic, sizeof(magic)) != 0) { goto badexit; }
+    if (!( getU64(fp, &word_bytes)
+        && getU64(fp, &entrypoint)
+        && getU64(fp, &rodata_bytes)
+        && getU64(fp, &ip_offset)
+        && getU64(fp, &frames)
+        && getU64(fp, &global_len)
+        && getU64(fp, &retarray_cap)
+        && getU64(fp, &block_count) )) { goto badexit; }
+    if (word_bytes != sizeof(word) || frames == 0) { goto badexit; }
+    frame_count = frames;
+    prog->entrypoint = entrypoint;
+    prog->rodataSize_bytes = rodata_bytes;
+    count = 3 + frame_count + block_count;
+    if (count < block_count) { goto badexit; } // overflow
+    regions = calloc(count, sizeof(Region));
+    if (regions == NULL) { goto badexit; }
+  }
+  globals_ix = 1 + frame_count;
+  retarray_ix = globals_ix + 1;
+  for (; loaded < count; ++loaded) {
+    Region* region = &regions[loaded];
+    if (!getU64(fp, &region->size_bytes) || !getU64(fp, &region->site)) { goto badexit; }
+    if (region->size_bytes > SIZE_MAX) { goto badexit; }
+    if (loaded == globals_ix && region->size_bytes != sizeof(word) * global_len) { goto badexit; }
+    if (loaded == retarray_ix && region->size_bytes != sizeof(word) * retarray_cap) { goto badexit; }
+    if (1 <= loaded && loaded < globals_ix && region->size_bytes < sizeof(StackFrame)) { goto badexit; }
+    if (loaded > retarray_ix) {
+      region->start = heapAlloc(&out->heap, region->size_bytes, region->site);
+    }
+    else if (loaded == 0) {
+      // so that the code can be protected again
+      region->start = allocProgramCode(region->size_bytes);
+    }
+    else if (region->size_bytes != 0) {
+      region->start = malloc(region->size_bytes);
+    }
+    if (region->start == NULL && region->size_bytes != 0) { goto badexit; }
+    if (fread(region->start, 1, region->size_bytes, fp) != region->size_bytes) {
+      ++loaded; // so that it is cleaned up
+      goto badexit;
+    }
+  }
+  for (size_t i = 1; i < globals_ix; ++i) {
+    StackFrame* frame = (StackFrame*)regions[i].start;
+    if (regions[i].size_bytes != frameBytes(frame)) { goto badexit; }
+  }
+  while (true) {
+    uint64_t ix, off, target, addend;
+    if (!getU64(fp, &ix)) { goto badexit; }
+    if (ix == RELOC_END) { break; }
+    if (!getU64(fp, &off) || !getU64(fp, &target) || !getU64(fp, &addend)) { goto badexit; }
+    if (ix >= count || off > regions[ix].size_bytes || regions[ix].size_bytes - off < sizeof(word)) { goto badexit; }
+    byte* ptr;
+    switch (target) {
+      case TARGET_STDIN: ptr = (byte*)out->streams[0]; break;
+      case TARGET_STDOUT: ptr = (byte*)out->streams[1]; break;
+      case TARGET_STDERR: ptr = (byte*)out->streams[2]; break;
+      default: {
+        if (target >= count || addend > regions[target].size_bytes) { goto badexit; }
+        ptr = regions[target].start + addend;
+      } break;
+    }
+    memcpy(regions[ix].start + off, &ptr, sizeof(ptr));
+  }
+  if (ip_offset >= regions[0].size_bytes) { goto badexit; }
+  if (prog->rodataSize_bytes > regions[0].size_bytes) { goto badexit; }
+  fclose(fp);
+  // link frames explicitly, rather than trusting the relocations to do it
+  for (size_t i = 1; i < globals_ix; ++i) {
+    StackFrame* frame = (StackFrame*)regions[i].start;
+    frame->prev = i + 1 < globals_ix ? (StackFrame*)regions[i + 1].start : NULL;
+  }
+  prog->code = regions[0].start;
+  prog->codeSize_bytes = regions[0].size_bytes;
+  protectProgram(prog);
+  out->program = prog;
+  out->ip = prog->code + ip_offset;
+  out->top = (StackFrame*)regions[1].start;
+  out->global.len = global_len;
+  out->global.at = (word*)regions[globals_ix].start;
+  out->retarray.cap = retarray_cap;
+  out->retarray.bufp = (word*)regions[retarray_ix].start;
+  out->environ.argc = argc;
+  out->environ.argv = argv;
+  free(regions);
+  return 0;
+  badexit: {
+    fclose(fp);
+    for (size_t i = 0; i < loaded; ++i) {
+      if (i > retarray_ix) { heapFree(&out->heap, regions[i].start); }
+      else { free(regions[i].start); }
+    }
+    free(regions);
+    return -1;
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "types.h"
+
+
+// A snapshot image holds everything needed to resume a machine: the code, the
+// frame chain, globals, return values, and every live block of its heap. The
+// image is only meaningful to a bsvm built for the same word size and byte
+// order that wrote it.
+//
+// Memory is not restored at the same addresses. Instead, every word-aligned
+// word that points into one of the saved regions (or at a `STRM` stream) is
+// recorded along with where it points, and patched on restore. Like a
+// conservative collector, this means an integer that happens to look like one
+// of those addresses is patched too. Some things cannot survive a restore at
+// all: files other than the standard streams, handles from `ARGV` (which point
+// into the old process' arguments), and pointers stored at unaligned offsets.
+//
+// Only a tracked heap (see heap.h) can be snapshotted.
+
+int writeSnapshot(const Machine* machine, const char* filename);
+
+// Recreate a machine from an image, allocating its blocks from `out->heap`,
+// which must already be initialized. The code is loaded into `prog`, which the
+// machine then borrows.
+int readSnapshot(Machine* out, Program* prog, const char* filename, size_t argc, char** argv);
+
+
+#endif
@@ -1,35 +1,113 @@
 #include "types.h"
 
+#include "execute.h"
 
-int initMachine(Machine* out, Program* prog, size_t argc, char** argv) {
-  // setup code and instruction pointer
-  out->program = prog;
-  out->ip = prog->code + prog->entrypoint;
-  size_t startFrameRegisters_count = readU32(&out->ip);
-  // setup main stack frame
-  out->top = malloc(sizeof(StackFrame) + sizeof(word) * startFrameRegisters_count);
-  out->top->prev = NULL;
-  if (out->top == NULL) { return 1; }
-  // setup globals
+
+// Give every field but the heap, the program and the stack the value a new
+// machine starts with, whether it then runs from its entrypoint or is filled
+// in from a snapshot.
+void initMachineState(Machine* out) {
+  out->top = NULL;
   out->global.len = 0;
   out->global.at = NULL;
-  // setup environment
-  out->environ.argc = argc;
-  out->environ.argv = argv;
-  // setup retarray
-  out->retarray.cap = 8;
-  out->retarray.bufp = malloc(sizeof(word) * out->retarray.cap);
+  out->retarray.cap = 0;
+  out->retarray.bufp = NULL;
+  out->environ.argc = 0;
+  out->environ.argv = NULL;
+  out->streams[0] = stdin;
+  out->streams[1] = stdout;
+  out->streams[2] = stderr;
+  out->aio = NULL;
+  out->aioKind = AIO_AUTO;
+  memset(out->callCache, 0, sizeof(out->callCache));
+  out->dispatch = normalDispatch;
+  out->debug = NULL;
+  out->iolog = NULL;
+  out->fuel = UINT64_MAX;
+  out->snapshotPath = NULL;
   out->shouldHalt = false;
   out->exitcode = -1;
+  out->program = NULL;
+  out->ip = NULL;
+}
+
+int initMachine(Machine* out, Program* prog, size_t argc, char** argv) {
+  initMachineState(out);
+  // setup heap (the host may swap in another kind before execution starts)
+  initHeap(&out->heap, HEAP_LIBC, false, false);
+  return resetMachine(out, prog, argc, argv);
+}
+
+// Prepare a machine to run `prog` from its entrypoint.
+// Memory from any previous run (the bottom stack frame, globals, retarray) is
+// reused rather than reallocated. Blocks a previous run left on the heap are
+// released too, but only if the heap is tracked; otherwise they leak.
+int resetMachine(Machine* self, Program* prog, size_t argc, char** argv) {
+  // setup code and instruction pointer
+  self->program = prog;
+  self->ip = prog->code + prog->entrypoint;
+  size_t startFrameRegisters_count = readU32(&self->ip);
+  // setup main stack frame, keeping only the bottom of any old stack
+  while (self->top != NULL && self->top->prev != NULL) {
+    StackFrame* prev = self->top->prev;
+    free(self->top);
+    self->top = prev;
+  }
+  if (self->top == NULL || self->top->size_words != startFrameRegisters_count) {
+    StackFrame* top = realloc(self->top, sizeof(StackFrame) + sizeof(word) * startFrameRegisters_count);
+    if (top == NULL) { return 1; }
+    self->top = top;
+  }
+  self->top->prev = NULL;
+  self->top->size_words = startFrameRegisters_count;
+  memset(self->top->r, 0, sizeof(word) * startFrameRegisters_count);
+  // setup globals (they are zeroed as they are grown back)
+  self->global.len = 0;
+  // a new program may well reuse the old one's addresses
+  memset(self->callCache, 0, sizeof(self->callCache));
+  // setup environment
+  self->environ.argc = argc;
+  self->environ.argv = argv;
+  // operations still in flight would land in memory about to be reused
+  destroyAsyncIo(self->aio);
+  self->aio = NULL;
+  if (self->heap.tracked) { heapFreeAll(&self->heap); }
+  // setup retarray
+  if (self->retarray.bufp == NULL) {
+    self->retarray.cap = 8;
+    self->retarray.bufp = malloc(sizeof(word) * self->retarray.cap);
+    if (self->retarray.bufp == NULL) { return 1; }
+  }
+  // effectively unlimited until the host says otherwise
+  self->fuel = UINT64_MAX;
+  self->shouldHalt = false;
+  self->exitcode = -1;
   return 0;
 }
 void destroyMachine(Machine* machine) {
   destroyStack(machine->top);
   free(machine->top);
   machine->top = NULL;
+  free(machine->global.at);
+  machine->global.at = NULL;
+  machine->global.len = 0;
   free(machine->retarray.bufp);
   machine->retarray.bufp = NULL;
   machine->retarray.cap = 0;
+  destroyAsyncIo(machine->aio);
+  machine->aio = NULL;
+  destroyHeap(&machine->heap);
+}
+
+// A machine that ran out of fuel is halted, but has not exited.
+// It can be resumed from where it stopped with `refuel`.
+bool isOutOfFuel(const Machine* machine) {
+  return machine->shouldHalt && machine->fuel == 0;
+}
+void refuel(Machine* machine, uint64_t fuel) {
+  if (fuel == 0) { return; }
+  if (isOutOfFuel(machine)) { machine->shouldHalt = false; }
+  machine->fuel = fuel;
 }
 
 void destroyStack(StackFrame* top) {
@@ -68,13 +146,3 @@ uintptr_t readWordOld(byte** ipp) {
   *ipp = ip;
   return out;
 }
-
-uintptr_t readVarint(byte** ipp) {
-  byte* ip = *ipp;
-  uintptr_t out = (*ip & 0x40) ? ~0 : 0;
-  do {
-    out = (out << 7) + (*ip & 0x7F);
-  } while (*ip++ & 0x80);
-  *ipp = ip;
-  return out;
-}
@@ -2,12 +2,15 @@
 #define TYPES_H
 
 #include "common.h"
+#include "aio.h"
+#include "heap.h"
 
 
 typedef struct Program Program;
 struct Program {
   byte* code;
   size_t codeSize_bytes;
+  size_t rodataSize_bytes; // how much of the end of `code` is read-only data, page-aligned
   ptrdiff_t entrypoint; // offset into `self.code` to begin execution
   // TODO symbol table for disassebly/debugging
   // TODO comments so disassembly can include them
@@ -16,8 +19,28 @@ struct Program {
 
 typedef struct Machine Machine;
 typedef struct StackFrame StackFrame;
+typedef struct Debugger Debugger;
+typedef struct IoLog IoLog;
+
+// Executes one instruction, whose opcode `ip` has just moved past.
+typedef void (*OpHandler)(Machine* machine);
+
+// Remembers, for an indirect call site, the last couple of functions it called
+// (see `enterIndirect` in execute/opcodes.c). Sites share slots direct-mapped
+// by address, so a slot only counts as a hit if `site` matches too.
+#define CALL_CACHE_SLOTS 64
+#define CALL_CACHE_WAYS 2
+typedef struct CallCacheSlot CallCacheSlot;
+struct CallCacheSlot {
+  const byte* site;
+  struct {
+    const byte* target; // the address called, i.e. of the frame size word
+    size_t frameSize_words;
+  } way[CALL_CACHE_WAYS]; // most recent first
+};
 
 struct Machine {
+  const OpHandler* dispatch; // indexed by opcode; see execute.h and debug.h
   byte* ip;
   StackFrame* top;
   struct {
@@ -32,15 +55,29 @@ struct Machine {
     size_t argc;
     char** argv; // a read-only borrow
   } environ;
+  Heap heap; // backs `NEW`/`FREE`/`RNEW`
+  FILE* streams[3]; // what `STRM` hands out; the standard streams unless the host swaps them
+  AsyncIo* aio; // NULL until the program first uses it
+  AioKind aioKind; // what kind of queue `aio` will be
+  CallCacheSlot callCache[CALL_CACHE_SLOTS]; // only valid for the current program
+  Debugger* debug; // a borrow; state for the instrumented dispatch tables
+  IoLog* iolog; // a borrow; state for the recording and replaying dispatch tables (see iolog.h)
+  uint64_t fuel; // control transfers left before yielding (see `burn` in execute/opcodes.c)
+  const char* snapshotPath; // a read-only borrow; where `SNAP` writes images (NULL disables it)
   bool shouldHalt;
   int exitcode;
   Program* program; // a read-only borrow
 };
+void initMachineState(Machine* out);
 int initMachine(Machine* out, Program* prog, size_t argc, char** argv);
+int resetMachine(Machine* machine, Program* prog, size_t argc, char** argv);
 void destroyMachine(Machine* machine);
+bool isOutOfFuel(const Machine* machine);
+void refuel(Machine* machine, uint64_t fuel);
 
 struct StackFrame {
   StackFrame* prev;
+  size_t size_words; // how many registers follow
   word r[]; // `r` for register
 };
 void destroyStack(StackFrame* top);
@@ -50,7 +87,16 @@ int32_t readI32(byte** ipp);
 uint32_t readU32(byte** ipp);
 uintptr_t readWordOld(byte** ipp);
 
-uintptr_t readVarint(byte** ipp);
+// Every operand goes through this, so it is inline rather than in types.c.
+static inline uintptr_t readVarint(byte** ipp) {
+  byte* ip = *ipp;
+  uintptr_t out = (*ip & 0x40) ? ~0 : 0;
+  do {
+    out = (out << 7) + (*ip & 0x7F);
+  } while (*ip++ & 0x80);
+  *ipp = ip;
+  return out;
+}
 
 
 #endif